@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 
+import argparse
 import subprocess
-import re
+import json
 import csv
 import os
+from concurrent.futures import ThreadPoolExecutor, as_completed
 import matplotlib.pyplot as plt
 import matplotlib
 matplotlib.use('Agg')
@@ -34,10 +36,11 @@ algorithms = [
 ]
 
 build_dir = 'build'
+out_dir = 'out'
 base_batsim_cmd = [
     'batsim',
     '-l', '', # Will be filled with the library path
-    '0', '',
+    '0', '', # Will be filled with the EDC initialization data
     '-p', 'assets/30machine.xml',
     '-w', 'assets/50jobs.json'
 ]
@@ -53,50 +56,131 @@ all_results = {alg['name']: [] for alg in algorithms}
 def ensure_directories():
     """Make sure necessary directories exist"""
     os.makedirs(build_dir, exist_ok=True)
-    os.makedirs("out", exist_ok=True)
+    os.makedirs(out_dir, exist_ok=True)
     os.makedirs("src", exist_ok=True)
 
-def modify_percentage_budget(cpp_file_path, percentage):
-    """Modifies the percentage budget in the C++ source file"""
-    if not os.path.exists(cpp_file_path):
-        raise FileNotFoundError(f"Source file not found: {cpp_file_path}")
-        
-    with open(cpp_file_path, 'r') as f:
-        lines = f.readlines()
+def build_schedulers():
+    """Builds all the scheduler libraries once, policy parameters are given at run time"""
+    if not os.path.exists(os.path.join(build_dir, 'build.ninja')):
+        setup_cmd = ['meson', 'setup', build_dir]
+        print(f"Configuring with: {' '.join(setup_cmd)}")
+        subprocess.run(setup_cmd, check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
 
-    pattern = r'(double\s+pourcentage_budget\s*=\s*)(\d+\.?\d*)(\s*;)'
-    modified = False
+    build_cmd = ['ninja', '-C', build_dir]
+    print(f"Building with: {' '.join(build_cmd)}")
+    subprocess.run(build_cmd, check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
 
-    for i, line in enumerate(lines):
-        if re.search(pattern, line):
-            lines[i] = re.sub(pattern, fr'\g<1>{percentage}\g<3>', line)
-            modified = True
-            break
-    
-    if not modified:
-        print(f"Warning: Pattern not found in {cpp_file_path}")
-    
-    with open(cpp_file_path, 'w') as f:
-        f.writelines(lines)
+def make_init_data(percentage, export_dir=out_dir):
+    """Returns the EDC initialization data (JSON) for a sweep point, see src/edc_config.hpp.
+    The decision component writes the metrics of the run to export_dir/metrics.json."""
+    return json.dumps({'budget_percentage': percentage,
+                       'metrics_file': os.path.join(export_dir, 'metrics.json')})
 
-def run_simulation(lib_path):
-    """Executes the Batsim simulation"""
+def point_dir(algorithm, percentage):
+    """Returns the output directory of a sweep point, so concurrent runs never share files"""
+    return os.path.join(out_dir, algorithm['name'], f"{percentage:g}")
+
+def run_simulation(lib_path, init_data='', export_dir=out_dir):
+    """Executes the Batsim simulation, its outputs and logs go to export_dir"""
     cmd = base_batsim_cmd.copy()
     cmd[2] = os.path.join('./', lib_path)  # Set the library path
+    cmd[4] = init_data  # Set the EDC initialization data
+    cmd += ['-e', os.path.join(export_dir, '')]  # Export prefix, e.g. out/PC_IDLE/0.5/
     
+    os.makedirs(export_dir, exist_ok=True)
     print(f"Running command: {' '.join(cmd)}")
-    result = subprocess.run(cmd, check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    with open(os.path.join(export_dir, 'batsim.log'), 'w') as log:
+        result = subprocess.run(cmd, check=True, stdout=log, stderr=subprocess.STDOUT)
     return result
 
-def parse_output():
+def run_point(algorithm, percentage):
+    """Runs one (algorithm, percentage) sweep point, returns its output directory"""
+    export_dir = point_dir(algorithm, percentage)
+    lib_path = os.path.join(build_dir, algorithm['lib_name'])
+    run_simulation(lib_path, make_init_data(percentage, export_dir), export_dir)
+    return export_dir
+
+def run_sweep(points, nb_workers):
+    """Runs all sweep points with up to nb_workers concurrent Batsim instances.
+    Returns the set of points whose simulation succeeded."""
+    succeeded = set()
+    with ThreadPoolExecutor(max_workers=nb_workers) as pool:
+        futures = {pool.submit(run_point, alg, p): (alg['name'], p) for alg, p in points}
+        for future in as_completed(futures):
+            name, p = futures[future]
+            try:
+                future.result()
+                succeeded.add((name, p))
+                print(f"Done: {name} with {p*100}% budget")
+            except subprocess.CalledProcessError as e:
+                print(f"Command failed for {name} with {p*100}% budget: {e}")
+                print(f"See {os.path.join(point_dir({'name': name}, p), 'batsim.log')}")
+            except Exception as e:
+                print(f"Error for {name} with {p*100}%: {e}")
+    return succeeded
+
+def gather_tables(points):
+    """Merges schedule.csv and jobs.csv of all sweep points into two tables
+    (out/sweep_schedule.csv and out/sweep_jobs.csv) with algorithm/percentage columns"""
+    for table in ['schedule', 'jobs']:
+        rows = []
+        fields = ['algorithm', 'percentage']
+        for alg, p in points:
+            path = os.path.join(point_dir(alg, p), f'{table}.csv')
+            if not os.path.exists(path):
+                continue
+            with open(path) as f:
+                reader = csv.DictReader(f)
+                for name in reader.fieldnames or []:
+                    if name not in fields:
+                        fields.append(name)
+                for row in reader:
+                    rows.append({'algorithm': alg['name'], 'percentage': p, **row})
+
+        merged_path = os.path.join(out_dir, f'sweep_{table}.csv')
+        with open(merged_path, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=fields)
+            writer.writeheader()
+            writer.writerows(rows)
+        print(f"Merged {len(rows)} rows into {merged_path}")
+
+def parse_metrics(metrics_path):
+    """Reads the metrics summary written by the decision component at the end of the run"""
+    with open(metrics_path) as f:
+        summary = json.load(f)
+
+    # Same energy model as for the Batsim outputs
+    makespan = summary['makespan']
+    nb_machines = summary['nb_hosts']
+    total_energy = (summary['time_computing'] * P_COMP_A) + (summary['time_idle'] * P_IDLE_A)
+    norm_energy = total_energy / (nb_machines * P_COMP_M * (makespan if makespan > 0 else 1))
+    return {
+        'utilization': summary['utilization'],
+        'norm_energy': norm_energy,
+        'avg_bsld': summary['avg_bsld']
+    }
+
+def parse_output(export_dir=out_dir):
     """Analyzes output files and calculates metrics"""
+    # The summary of the decision component avoids reading the per-job outputs back
+    metrics_path = os.path.join(export_dir, 'metrics.json')
+    if os.path.exists(metrics_path):
+        metrics = parse_metrics(metrics_path)
+        print(f"bsld: {metrics['avg_bsld']}")
+        print(f"energy: {metrics['norm_energy']}")
+        print(f"utilization: {metrics['utilization']}")
+        return metrics
+
+    schedule_path = os.path.join(export_dir, 'schedule.csv')
+    jobs_path = os.path.join(export_dir, 'jobs.csv')
+
     # Check if output files exist
-    if not os.path.exists("./out/schedule.csv"):
+    if not os.path.exists(schedule_path):
         print("Warning: schedule.csv not found")
         return {'utilization': 0, 'norm_energy': 0, 'avg_bsld': 0}
         
     # Read schedule file
-    with open("./out/schedule.csv") as f:
+    with open(schedule_path) as f:
         reader = csv.DictReader(f)
         rows = list(reader)
         if not rows:
@@ -121,11 +205,11 @@ def parse_output():
         norm_energy = total_energy / max_energy 
     
     # Read jobs file for BSLD
-    if not os.path.exists("./out/jobs.csv"):
+    if not os.path.exists(jobs_path):
         print("Warning: jobs.csv not found")
         return {'utilization': utilization, 'norm_energy': norm_energy, 'avg_bsld': 0}
         
-    with open("./out/jobs.csv") as f:
+    with open(jobs_path) as f:
         jobs = list(csv.DictReader(f))
     
     bslds = []
@@ -180,47 +264,50 @@ def plot_comparative_results(all_results):
     plt.savefig('comparative_results.png')
     print("Plot saved as 'comparative_results.png'")
 
+def parse_args():
+    parser = argparse.ArgumentParser(description='Runs the energy budget sweep and plots the results')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1,
+                        help='number of Batsim instances run concurrently (default: number of CPUs)')
+    return parser.parse_args()
+
 # Main execution
 def main():
+    args = parse_args()
     ensure_directories()
-    
+
+    # A single build serves the whole sweep
+    try:
+        build_schedulers()
+    except subprocess.CalledProcessError as e:
+        print(f"Build failed: {e}")
+        print(f"stdout: {e.stdout.decode('utf-8')}")
+        print(f"stderr: {e.stderr.decode('utf-8')}")
+        return
+
+    enabled = []
     for algorithm in algorithms:
-        print(f"\n=== Processing algorithm: {algorithm['name']} ===")
-        
         # Check if source file exists
         if not os.path.exists(algorithm['cpp_file']):
             print(f"Warning: Source file {algorithm['cpp_file']} not found. Skipping algorithm.")
             continue
-            
+        enabled.append(algorithm)
+
+    # Every point has its own export directory and init data, so they all run concurrently
+    points = [(alg, p) for alg in enabled for p in percentages]
+    print(f"\n=== Running {len(points)} simulations with {args.jobs} workers ===")
+    succeeded = run_sweep(points, args.jobs)
+
+    for algorithm in enabled:
+        print(f"\n=== Processing algorithm: {algorithm['name']} ===")
         algorithm_results = []
         
         for p in percentages:
+            if (algorithm['name'], p) not in succeeded:
+                continue
             print(f"\nProcessing {algorithm['name']} with {p*100}% budget...")
             try:
-                # Modify budget percentage in source file
-                modify_percentage_budget(algorithm['cpp_file'], p)
-                
-                # Build the library
-                build_cmd = ['ninja', '-C', build_dir]
-                print(f"Building with: {' '.join(build_cmd)}")
-                build_result = subprocess.run(build_cmd, check=True, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-                
-                # Set the library path for this algorithm
-                lib_path = os.path.join(build_dir, algorithm['lib_name'])
-                
-                # Run simulation
-                run_simulation(lib_path)
-                
-                # Parse output
-                metrics = parse_output()
+                metrics = parse_output(point_dir(algorithm, p))
                 algorithm_results.append({'percentage': p, **metrics})
-                
-            except FileNotFoundError as e:
-                print(f"File not found error: {e}")
-            except subprocess.CalledProcessError as e:
-                print(f"Command failed: {e}")
-                print(f"stdout: {e.stdout.decode('utf-8')}")
-                print(f"stderr: {e.stderr.decode('utf-8')}")
             except Exception as e:
                 print(f"Error for {p*100}%: {e}")
         
@@ -232,6 +319,9 @@ def main():
         print("Budget | Utilization | Energy | BSLD")
         for r in algorithm_results:
             print(f"{r['percentage']*100:5.0f}% | {r['utilization']:10.3f} | {r['norm_energy']:7.3f} | {r['avg_bsld']:5.3f}")
+
+    # One result table for the whole sweep
+    gather_tables([(alg, p) for alg, p in points if (alg['name'], p) in succeeded])
     
     # Generate comparative plots
     plot_comparative_results(all_results)
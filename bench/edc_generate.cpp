@@ -0,0 +1,176 @@
+// Generator of large Batsim platforms and workloads, for scaling tests of the decision components.
+// Both files are streamed to disk as they are generated: memory does not grow with the number of
+// jobs nor hosts. The workload follows the usual traits of HPC logs: a quarter of serial jobs,
+// mostly power-of-two sizes, log-normal walltimes rounded up as users request them, jobs ending
+// before their walltime, and arrivals following a daily cycle at a target offered load.
+//
+//   edc_generate [--platform <file.xml>] [--workload <file.json>] [options]
+//     --hosts <n>     number of computation hosts (default 1024)
+//     --jobs <n>      number of jobs of the workload (default 100000)
+//     --load <x>      offered load of the workload, in platform fractions (default 0.9)
+//     --max-size <n>  largest job size (default: the number of hosts)
+//     --seed <n>      seed of the workload (default 1)
+//     --speed <s>     speed of the hosts (default 10Gf)
+//     --p-idle <w>, --p-comp <w>, --p-off <w>  power of an idle, computing and off host
+//                     (default 100, 203.12 and 9.75 W)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static const double SECONDS_PER_DAY = 86400;
+static const double PI = 3.14159265358979323846;
+
+// Writes a platform of nb_hosts computation hosts and the Batsim master host
+static bool write_platform(const char * path, uint32_t nb_hosts, const std::string & speed,
+                           double p_idle, double p_comp, double p_off) {
+  FILE * file = fopen(path, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot write platform '%s'\n", path);
+    return false;
+  }
+
+  fprintf(file, "<?xml version='1.0'?>\n"
+                "<!DOCTYPE platform SYSTEM \"https://simgrid.org/simgrid.dtd\">\n"
+                "<platform version=\"4.1\">\n"
+                "<zone id=\"generated_%u_machines\" routing=\"Full\">\n", nb_hosts);
+  // pstate 0 computes, pstate 1 is the low-power state of switched off hosts
+  for (uint32_t host = 0; host < nb_hosts; ++host) {
+    fprintf(file, "    <host id=\"node_%u\" speed=\"%s, 1f\" pstate=\"0\">\n"
+                  "        <prop id=\"wattage_per_state\" value=\"%g:%g:%g, %g:%g:%g\"/>\n"
+                  "        <prop id=\"wattage_off\" value=\"%g\"/>\n"
+                  "    </host>\n",
+            host, speed.c_str(), p_idle, p_idle, p_comp, p_off, p_off, p_off, p_off);
+  }
+  fprintf(file, "    <host id=\"master_host\" speed=\"100Mf\"/>\n"
+                "</zone>\n"
+                "</platform>\n");
+
+  bool ok = (ferror(file) == 0);
+  return (fclose(file) == 0) && ok;
+}
+
+static bool write_workload(const char * path, uint32_t nb_jobs, uint32_t nb_hosts, uint32_t max_size,
+                           double load, unsigned seed) {
+  FILE * file = fopen(path, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot write workload '%s'\n", path);
+    return false;
+  }
+
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::lognormal_distribution<double> walltimes(std::log(3600.0), 1.5);
+  std::exponential_distribution<double> arrivals(1.0);
+  double max_log_size = std::log2(static_cast<double>(max_size));
+
+  // delays are whole seconds up to a week: one delay profile per distinct value
+  const uint32_t max_delay = 7 * static_cast<uint32_t>(SECONDS_PER_DAY);
+  std::vector<bool> used_delays(max_delay + 1, false);
+
+  fprintf(file, "{\n  \"description\": \"%u generated jobs, load %g\",\n  \"nb_res\": %u,\n  \"jobs\": [",
+          nb_jobs, load, nb_hosts);
+
+  double time = 0;
+  for (uint32_t i = 0; i < nb_jobs; ++i) {
+    // sizes: serial jobs, then log-uniform sizes, mostly rounded to powers of two
+    uint32_t size = 1;
+    if (uniform(rng) >= 0.24) {
+      double log_size = uniform(rng) * max_log_size;
+      size = (uniform(rng) < 0.75) ? (1u << static_cast<uint32_t>(std::lround(log_size)))
+                                   : static_cast<uint32_t>(std::pow(2.0, log_size));
+      size = std::max<uint32_t>(1, std::min(size, max_size));
+    }
+
+    // requested walltimes are rounded up to 15 minutes, jobs run for a part of it
+    double walltime = std::min(std::max(walltimes(rng), 60.0), static_cast<double>(max_delay));
+    walltime = std::min(std::ceil(walltime / 900.0) * 900.0, static_cast<double>(max_delay));
+    double fraction = uniform(rng);
+    double run_fraction = (fraction < 0.15) ? 1.0                              // killed at walltime
+                        : (fraction < 0.25) ? 0.1 * uniform(rng)              // early failures
+                                            : 0.1 + 0.9 * uniform(rng);
+    uint32_t delay = std::max<uint32_t>(1, static_cast<uint32_t>(std::ceil(walltime * run_fraction)));
+    used_delays[delay] = true;
+
+    // arrivals keep the offered load, three times as many at the daily peak as at night
+    double daily = 1.0 + 0.5 * std::sin(2 * PI * (time / SECONDS_PER_DAY - 0.25));
+    time += arrivals(rng) * (static_cast<double>(size) * delay) / (nb_hosts * load * daily);
+
+    fprintf(file, "%s\n    {\"id\": \"%u\", \"profile\": \"d%u\", \"res\": %u, \"walltime\": %.0f, \"subtime\": %.0f}",
+            (i == 0) ? "" : ",", i, delay, size, walltime, std::floor(time));
+  }
+
+  fprintf(file, "\n  ],\n  \"profiles\": {");
+  bool first = true;
+  for (uint32_t delay = 0; delay <= max_delay; ++delay) {
+    if (used_delays[delay]) {
+      fprintf(file, "%s\n    \"d%u\": {\"type\": \"delay\", \"delay\": %u}", first ? "" : ",", delay, delay);
+      first = false;
+    }
+  }
+  fprintf(file, "\n  }\n}\n");
+
+  bool ok = (ferror(file) == 0);
+  return (fclose(file) == 0) && ok;
+}
+
+int main(int argc, char ** argv) {
+  const char * platform_path = nullptr;
+  const char * workload_path = nullptr;
+  uint32_t nb_hosts = 1024;
+  uint32_t nb_jobs = 100000;
+  uint32_t max_size = 0;
+  double load = 0.9;
+  unsigned seed = 1;
+  std::string speed = "10Gf";
+  double p_idle = 100.0, p_comp = 203.12, p_off = 9.75;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value of '%s'\n", argv[i]);
+      return 2;
+    }
+    const char * value = argv[++i];
+    if (arg == "--platform") platform_path = value;
+    else if (arg == "--workload") workload_path = value;
+    else if (arg == "--hosts") nb_hosts = static_cast<uint32_t>(atol(value));
+    else if (arg == "--jobs") nb_jobs = static_cast<uint32_t>(atol(value));
+    else if (arg == "--load") load = atof(value);
+    else if (arg == "--max-size") max_size = static_cast<uint32_t>(atol(value));
+    else if (arg == "--seed") seed = static_cast<unsigned>(atol(value));
+    else if (arg == "--speed") speed = value;
+    else if (arg == "--p-idle") p_idle = atof(value);
+    else if (arg == "--p-comp") p_comp = atof(value);
+    else if (arg == "--p-off") p_off = atof(value);
+    else {
+      fprintf(stderr, "Unknown argument '%s'\n", argv[i - 1]);
+      return 2;
+    }
+  }
+
+  max_size = (max_size == 0) ? nb_hosts : std::min(max_size, nb_hosts);
+  if (platform_path == nullptr && workload_path == nullptr) {
+    fprintf(stderr, "usage: %s [--platform <file.xml>] [--workload <file.json>] [--hosts <n>] [--jobs <n>] "
+                    "[--load <x>] [--max-size <n>] [--seed <n>] [--speed <s>] [--p-idle <w>] [--p-comp <w>] [--p-off <w>]\n",
+            argv[0]);
+    return 2;
+  }
+  if (nb_hosts == 0 || load <= 0) {
+    fprintf(stderr, "Invalid platform of %u hosts or load %g\n", nb_hosts, load);
+    return 2;
+  }
+
+  if (platform_path != nullptr && !write_platform(platform_path, nb_hosts, speed, p_idle, p_comp, p_off)) {
+    return 1;
+  }
+  if (workload_path != nullptr && !write_workload(workload_path, nb_jobs, nb_hosts, max_size, load, seed)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,514 @@
+// Replay benchmark of the decision components, without Batsim nor SimGrid.
+// The library is loaded through the batsim_edc.h C API and fed the events Batsim would send for a
+// workload, jobs running exactly for their profile delay (or walltime). Only the time spent in
+// batsim_edc_take_decisions() is measured.
+//
+//   edc_replay <library.so> (<workload.json> | --synthetic <nb_jobs>) [options]
+//     --hosts <n>     number of hosts (default: nb_res of the workload, or 1024)
+//     --init <json>   initialization data of the library (default: '{"log_level": "off"}')
+//     --seed <n>      seed of the synthetic workload (default 1)
+//     --restore <snapshot.json>
+//                     resume from a snapshot of the library (see src/edc_snapshot.hpp) taken on the
+//                     same workload: its restore_file is set, and the replay starts at the snapshot
+//                     time with the jobs pending or running in it, those submitted earlier being done
+//
+// Pstate changes are applied with the sleep_pstate, awake_pstate, switch_off_time and switch_on_time
+// keys of the initialization data: jobs may not run on hosts asleep or switching pstate.
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <batprotocol.hpp>
+#include <nlohmann/json.hpp>
+
+#include "batsim_edc.h"
+
+using namespace batprotocol;
+
+typedef uint8_t (*InitFunction)(const uint8_t *, uint32_t, uint32_t);
+typedef uint8_t (*DeinitFunction)();
+typedef uint8_t (*TakeDecisionsFunction)(const uint8_t *, uint32_t, uint8_t **, uint32_t *);
+
+struct ReplayJob {
+  std::string id;
+  double submission_time = 0;
+  uint32_t nb_hosts = 0;
+  double walltime = 0;
+  double run_time = 0; // Time the job runs once launched
+  std::vector<uint32_t> hosts;
+  bool started = false;
+  bool finished = false;
+};
+
+// An event of the replay: a job submission or completion, or a requested call
+struct ReplayEvent {
+  enum Type { SUBMISSION, COMPLETION, CALL };
+  double time;
+  uint64_t order; // Events at the same time keep their creation order
+  Type type;
+  uint32_t job;
+  std::string call_id;
+
+  bool operator>(const ReplayEvent & other) const {
+    return (time > other.time) || (time == other.time && order > other.order);
+  }
+};
+
+// Sleep pstate of the hosts, as read by the library (see SleepConfig in src/resource_index.hpp)
+struct ReplaySleep {
+  uint32_t awake_pstate = 0;
+  uint32_t sleep_pstate = 1;
+  double switch_off_time = 0;
+  double switch_on_time = 0;
+};
+
+static bool read_sleep(const std::string & init, ReplaySleep & sleep) {
+  try {
+    nlohmann::json config = nlohmann::json::parse(init);
+    sleep.awake_pstate = config.value("awake_pstate", sleep.awake_pstate);
+    sleep.sleep_pstate = config.value("sleep_pstate", sleep.sleep_pstate);
+    sleep.switch_off_time = config.value("switch_off_time", sleep.switch_off_time);
+    sleep.switch_on_time = config.value("switch_on_time", sleep.switch_on_time);
+  } catch (const nlohmann::json::exception & e) {
+    fprintf(stderr, "Invalid init data: %s\n", e.what());
+    return false;
+  }
+  return true;
+}
+
+static bool load_workload(const char * path, std::vector<ReplayJob> & jobs, uint32_t & nb_res) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "Cannot read workload '%s'\n", path);
+    return false;
+  }
+
+  nlohmann::json workload;
+  try {
+    workload = nlohmann::json::parse(file);
+    nb_res = workload.value("nb_res", 0u);
+    const nlohmann::json & profiles = workload.contains("profiles") ? workload["profiles"] : nlohmann::json::object();
+    for (const nlohmann::json & entry : workload.at("jobs")) {
+      ReplayJob job;
+      job.id = "w0!" + (entry.at("id").is_string() ? entry.at("id").get<std::string>()
+                                                    : std::to_string(entry.at("id").get<long long>()));
+      job.submission_time = entry.at("subtime").get<double>();
+      job.nb_hosts = entry.at("res").get<uint32_t>();
+      job.walltime = entry.value("walltime", 0.0);
+
+      // delay profiles give the actual run time, others run for their walltime
+      job.run_time = job.walltime;
+      auto profile = profiles.find(entry.value("profile", ""));
+      if (profile != profiles.end() && profile->value("type", "") == "delay") {
+        job.run_time = profile->value("delay", job.walltime);
+        if (job.walltime > 0) {
+          job.run_time = std::min(job.run_time, job.walltime);
+        }
+      }
+      jobs.push_back(std::move(job));
+    }
+  } catch (const nlohmann::json::exception & e) {
+    fprintf(stderr, "Invalid workload '%s': %s\n", path, e.what());
+    return false;
+  }
+
+  std::stable_sort(jobs.begin(), jobs.end(), [](const ReplayJob & a, const ReplayJob & b) {
+    return a.submission_time < b.submission_time;
+  });
+  return true;
+}
+
+// Jobs mostly small with a few wide ones, log-normal walltimes, arrivals keeping the platform busy
+static void make_synthetic_workload(uint32_t nb_jobs, uint32_t nb_hosts, unsigned seed, std::vector<ReplayJob> & jobs) {
+  std::mt19937_64 rng(seed);
+  std::lognormal_distribution<double> walltimes(std::log(1800.0), 1.2);
+  std::uniform_real_distribution<double> run_fraction(0.2, 1.0);
+  std::geometric_distribution<uint32_t> size_log(0.35);
+
+  double mean_hosts = std::min<double>(nb_hosts, 8.0);
+  std::exponential_distribution<double> interarrivals(nb_hosts / (mean_hosts * 1800.0));
+
+  double time = 0;
+  jobs.resize(nb_jobs);
+  for (uint32_t i = 0; i < nb_jobs; ++i) {
+    ReplayJob & job = jobs[i];
+    job.id = "w0!" + std::to_string(i);
+    time += interarrivals(rng);
+    job.submission_time = std::floor(time);
+    uint32_t log_size = std::min<uint32_t>(size_log(rng), 20);
+    job.nb_hosts = std::max<uint32_t>(1, std::min<uint32_t>(nb_hosts, 1u << log_size));
+    job.walltime = std::ceil(std::min(walltimes(rng), 86400.0));
+    job.run_time = std::ceil(job.walltime * run_fraction(rng));
+  }
+}
+
+// Hosts of an intervalset string such as "0-3,5" or "0-3 5"
+static void parse_hosts(const char * text, std::vector<uint32_t> & hosts) {
+  hosts.clear();
+  const char * c = text;
+  while (*c != '\0') {
+    if (*c == ',' || *c == ' ') {
+      ++c;
+      continue;
+    }
+    char * end;
+    uint32_t first = static_cast<uint32_t>(strtoul(c, &end, 10));
+    uint32_t last = first;
+    if (*end == '-') {
+      last = static_cast<uint32_t>(strtoul(end + 1, &end, 10));
+    }
+    for (uint32_t host = first; host <= last; ++host) {
+      hosts.push_back(host);
+    }
+    c = end;
+  }
+}
+
+static double percentile(const std::vector<uint64_t> & sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+  return sorted[index] / 1e3;
+}
+
+int main(int argc, char ** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <library.so> (<workload.json> | --synthetic <nb_jobs>) "
+                    "[--hosts <n>] [--init <json>] [--seed <n>] [--restore <snapshot.json>]\n", argv[0]);
+    return 2;
+  }
+
+  const char * library_path = argv[1];
+  const char * workload_path = nullptr;
+  uint32_t nb_synthetic = 0;
+  uint32_t nb_hosts = 0;
+  std::string init = "{\"log_level\": \"off\"}";
+  unsigned seed = 1;
+  const char * restore_path = nullptr;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--synthetic" && i + 1 < argc) {
+      nb_synthetic = static_cast<uint32_t>(atol(argv[++i]));
+    } else if (arg == "--hosts" && i + 1 < argc) {
+      nb_hosts = static_cast<uint32_t>(atol(argv[++i]));
+    } else if (arg == "--init" && i + 1 < argc) {
+      init = argv[++i];
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = static_cast<unsigned>(atol(argv[++i]));
+    } else if (arg == "--restore" && i + 1 < argc) {
+      restore_path = argv[++i];
+    } else if (workload_path == nullptr && arg.compare(0, 2, "--") != 0) {
+      workload_path = argv[i];
+    } else {
+      fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+      return 2;
+    }
+  }
+
+  // workload
+  std::vector<ReplayJob> jobs;
+  if (workload_path != nullptr) {
+    uint32_t nb_res = 0;
+    if (!load_workload(workload_path, jobs, nb_res)) {
+      return 1;
+    }
+    nb_hosts = (nb_hosts == 0) ? nb_res : nb_hosts;
+  } else {
+    nb_hosts = (nb_hosts == 0) ? 1024 : nb_hosts;
+    make_synthetic_workload(nb_synthetic, nb_hosts, seed, jobs);
+  }
+  if (nb_hosts == 0 || jobs.empty()) {
+    fprintf(stderr, "Nothing to replay: %u hosts, %zu jobs\n", nb_hosts, jobs.size());
+    return 1;
+  }
+
+  // snapshot to resume from, read by the library too
+  nlohmann::json snapshot;
+  if (restore_path != nullptr) {
+    std::ifstream file(restore_path);
+    try {
+      snapshot = nlohmann::json::parse(file);
+      nlohmann::json init_data = nlohmann::json::parse(init);
+      init_data["restore_file"] = restore_path;
+      init = init_data.dump();
+    } catch (const nlohmann::json::exception & e) {
+      fprintf(stderr, "Invalid snapshot '%s' or init data: %s\n", restore_path, e.what());
+      return 1;
+    }
+  }
+
+  ReplaySleep sleep;
+  if (!read_sleep(init, sleep)) {
+    return 1;
+  }
+
+  // decision component
+  void * library = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+  if (library == nullptr) {
+    fprintf(stderr, "Cannot load '%s': %s\n", library_path, dlerror());
+    return 1;
+  }
+  auto edc_init = reinterpret_cast<InitFunction>(dlsym(library, "batsim_edc_init"));
+  auto edc_deinit = reinterpret_cast<DeinitFunction>(dlsym(library, "batsim_edc_deinit"));
+  auto edc_take_decisions = reinterpret_cast<TakeDecisionsFunction>(dlsym(library, "batsim_edc_take_decisions"));
+  if (edc_init == nullptr || edc_deinit == nullptr || edc_take_decisions == nullptr) {
+    fprintf(stderr, "'%s' does not implement the batsim_edc.h API\n", library_path);
+    return 1;
+  }
+  if (edc_init(reinterpret_cast<const uint8_t *>(init.data()), static_cast<uint32_t>(init.size()),
+               BATSIM_EDC_FORMAT_BINARY) != 0) {
+    fprintf(stderr, "Initialization of '%s' failed\n", library_path);
+    return 1;
+  }
+
+  std::unordered_map<std::string, uint32_t> job_of_id;
+  job_of_id.reserve(jobs.size());
+  std::priority_queue<ReplayEvent, std::vector<ReplayEvent>, std::greater<ReplayEvent>> events;
+  uint64_t nb_created_events = 0;
+  for (uint32_t i = 0; i < jobs.size(); ++i) {
+    job_of_id.emplace(jobs[i].id, i);
+  }
+
+  std::vector<char> busy(nb_hosts, 0);
+  std::vector<char> asleep(nb_hosts, 0);
+  std::vector<double> ready_time(nb_hosts, 0); // End of the last pstate transition of each host
+  std::vector<uint64_t> latencies;
+  uint64_t nb_decisions = 0, nb_launched = 0, nb_rejected = 0, nb_calls = 0, nb_finished = 0;
+  uint64_t nb_switched_off = 0, nb_switched_on = 0;
+  std::vector<uint32_t> hosts;
+
+  MessageBuilder mb(false);
+  double now = 0;
+  bool first_message = true;
+  std::vector<char> submitted(jobs.size(), 0);
+  if (restore_path != nullptr) {
+    // the library already knows the jobs of the snapshot and its platform
+    try {
+      now = snapshot.at("time").get<double>();
+      for (const nlohmann::json & entry : snapshot.at("pending")) {
+        auto it = job_of_id.find(entry.at("id").get<std::string>());
+        if (it != job_of_id.end()) {
+          submitted[it->second] = 1;
+        }
+      }
+      for (const nlohmann::json & entry : snapshot.at("running")) {
+        auto it = job_of_id.find(entry.at("id").get<std::string>());
+        if (it == job_of_id.end()) {
+          fprintf(stderr, "Job %s of snapshot '%s' not in the workload\n", entry.at("id").get<std::string>().c_str(), restore_path);
+          return 1;
+        }
+        ReplayJob & job = jobs[it->second];
+        for (const nlohmann::json & range : entry.at("hosts")) {
+          for (uint32_t host = range.at(0).get<uint32_t>(); host <= range.at(1).get<uint32_t>() && host < nb_hosts; ++host) {
+            job.hosts.push_back(host);
+            busy[host] = 1;
+          }
+        }
+        job.started = true;
+        submitted[it->second] = 1;
+        events.push({std::max(now, entry.at("start_time").get<double>() + job.run_time), nb_created_events++,
+                     ReplayEvent::COMPLETION, it->second, ""});
+      }
+      // hosts asleep, or switching pstate until the end of their transition
+      auto set_hosts = [&](const nlohmann::json & ranges, bool off, double end) {
+        for (const nlohmann::json & range : ranges) {
+          for (uint32_t host = range.at(0).get<uint32_t>(); host <= range.at(1).get<uint32_t>() && host < nb_hosts; ++host) {
+            asleep[host] = off;
+            ready_time[host] = end;
+          }
+        }
+      };
+      set_hosts(snapshot.at("asleep"), true, now);
+      for (const nlohmann::json & transition : snapshot.at("transitions")) {
+        set_hosts(transition.at("hosts"), !transition.at("on").get<bool>(), transition.at("end").get<double>());
+      }
+      for (const nlohmann::json & wakeup : snapshot.at("wakeups")) {
+        events.push({wakeup.get<double>(), nb_created_events++, ReplayEvent::CALL, 0, "wakeup!restored"});
+      }
+    } catch (const nlohmann::json::exception & e) {
+      fprintf(stderr, "Invalid snapshot '%s': %s\n", restore_path, e.what());
+      return 1;
+    }
+    for (uint32_t i = 0; i < jobs.size(); ++i) {
+      if (!submitted[i] && jobs[i].submission_time <= now) {
+        jobs[i].finished = true;
+        submitted[i] = 1;
+        ++nb_finished;
+      }
+    }
+    first_message = false;
+  }
+  for (uint32_t i = 0; i < jobs.size(); ++i) {
+    if (!submitted[i]) {
+      events.push({jobs[i].submission_time, nb_created_events++, ReplayEvent::SUBMISSION, i, ""});
+    }
+  }
+  bool ended = false;
+  while (!ended) {
+    // the events of the next instant form a message
+    mb.clear(now);
+    if (first_message) {
+      mb.add_batsim_hello("edc_replay");
+      auto begins = SimulationBegins::make();
+      begins->set_host_number(nb_hosts, 0);
+      auto speed = std::make_shared<std::vector<double>>(1, 1e9);
+      for (uint32_t host = 0; host < nb_hosts; ++host) {
+        begins->add_host(host, "host" + std::to_string(host), 0, 1, fb::HostState_Idle, 1, speed);
+      }
+      mb.add_simulation_begins(begins);
+      first_message = false;
+    }
+    while (!events.empty() && events.top().time <= now) {
+      ReplayEvent event = events.top();
+      events.pop();
+      ReplayJob & job = jobs[event.job];
+      switch (event.type) {
+        case ReplayEvent::SUBMISSION: {
+          auto submitted = Job::make();
+          submitted->set_resource_number(job.nb_hosts);
+          submitted->set_walltime(job.walltime);
+          submitted->set_profile("delay");
+          mb.add_job_submitted(job.id, submitted, now);
+        } break;
+        case ReplayEvent::COMPLETION: {
+          for (uint32_t host : job.hosts) {
+            busy[host] = 0;
+          }
+          job.finished = true;
+          ++nb_finished;
+          mb.add_job_completed(job.id, fb::FinalJobState_COMPLETED_SUCCESSFULLY);
+        } break;
+        case ReplayEvent::CALL: {
+          mb.add_requested_call(event.call_id);
+        } break;
+      }
+    }
+    ended = (nb_finished + nb_rejected == jobs.size());
+    if (ended) {
+      mb.add_simulation_ends();
+    }
+    mb.finish_message(now);
+
+    uint8_t * decisions = nullptr;
+    uint32_t decisions_size = 0;
+    auto begin = std::chrono::steady_clock::now();
+    edc_take_decisions(mb.buffer_pointer(), mb.buffer_size(), &decisions, &decisions_size);
+    auto end = std::chrono::steady_clock::now();
+    latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()));
+
+    // apply the decisions, checking that they are valid
+    auto message = fb::GetMessage(decisions);
+    for (unsigned int i = 0; message->decisions() != nullptr && i < message->decisions()->size(); ++i) {
+      auto decision = (*message->decisions())[i];
+      ++nb_decisions;
+      switch (decision->decision_type()) {
+        case fb::Decision_ExecuteJobDecision: {
+          auto execute = decision->decision_as_ExecuteJobDecision();
+          auto it = job_of_id.find(execute->job_id()->str());
+          if (it == job_of_id.end() || jobs[it->second].started) {
+            fprintf(stderr, "[%g] Invalid execution of job %s\n", now, execute->job_id()->c_str());
+            return 1;
+          }
+          ReplayJob & job = jobs[it->second];
+          parse_hosts(execute->allocation()->host_allocation()->c_str(), hosts);
+          if (hosts.size() != job.nb_hosts) {
+            fprintf(stderr, "[%g] Job %s executed on %zu hosts instead of %u\n", now, job.id.c_str(), hosts.size(), job.nb_hosts);
+            return 1;
+          }
+          for (uint32_t host : hosts) {
+            if (host >= nb_hosts || busy[host] || asleep[host] || ready_time[host] > now) {
+              fprintf(stderr, "[%g] Job %s executed on unavailable host %u\n", now, job.id.c_str(), host);
+              return 1;
+            }
+            busy[host] = 1;
+          }
+          job.hosts = hosts;
+          job.started = true;
+          ++nb_launched;
+          events.push({now + job.run_time, nb_created_events++, ReplayEvent::COMPLETION, it->second, ""});
+        } break;
+        case fb::Decision_RejectJobDecision: {
+          ++nb_rejected;
+        } break;
+        case fb::Decision_CallMeLaterDecision: {
+          auto call = decision->decision_as_CallMeLaterDecision();
+          if (call->when_type() == fb::TemporalTrigger_OneShot) {
+            double time = std::max(now, static_cast<double>(call->when_as_OneShot()->time()));
+            ++nb_calls;
+            events.push({time, nb_created_events++, ReplayEvent::CALL, 0, call->call_me_later_id()->str()});
+          }
+        } break;
+        case fb::Decision_ChangeHostPStateDecision: {
+          auto change = decision->decision_as_ChangeHostPStateDecision();
+          bool off = (change->pstate() == sleep.sleep_pstate);
+          if (!off && change->pstate() != sleep.awake_pstate) {
+            fprintf(stderr, "[%g] Unknown pstate %u\n", now, change->pstate());
+            return 1;
+          }
+          // only idle hosts are switched off, and only asleep ones on, once their transition ended
+          parse_hosts(change->host_ids()->c_str(), hosts);
+          for (uint32_t host : hosts) {
+            if (host >= nb_hosts || busy[host] || ready_time[host] > now || asleep[host] == off) {
+              fprintf(stderr, "[%g] Host %u switched %s while unavailable\n", now, host, off ? "off" : "on");
+              return 1;
+            }
+            asleep[host] = off;
+            ready_time[host] = now + (off ? sleep.switch_off_time : sleep.switch_on_time);
+          }
+          (off ? nb_switched_off : nb_switched_on) += hosts.size();
+        } break;
+        default: break;
+      }
+    }
+
+    if (!ended) {
+      if (events.empty()) {
+        fprintf(stderr, "[%g] Stalled: %zu jobs never complete\n", now, jobs.size() - nb_finished - nb_rejected);
+        break;
+      }
+      now = events.top().time;
+    }
+  }
+
+  edc_deinit();
+  dlclose(library);
+
+  // report
+  double total_s = 0;
+  for (uint64_t latency : latencies) {
+    total_s += latency / 1e9;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  printf("library      %s\n", library_path);
+  printf("workload     %zu jobs on %u hosts, simulated until %.0f s\n", jobs.size(), nb_hosts, now);
+  printf("outcome      %lu launched, %lu rejected, %lu finished, %lu calls requested%s\n",
+         (unsigned long) nb_launched, (unsigned long) nb_rejected, (unsigned long) nb_finished,
+         (unsigned long) nb_calls, ended ? "" : " (stalled)");
+  if (nb_switched_off + nb_switched_on > 0) {
+    printf("pstates      %lu hosts switched off, %lu on\n", (unsigned long) nb_switched_off,
+           (unsigned long) nb_switched_on);
+  }
+  printf("scheduler    %zu calls, %lu decisions in %.3f s: %.0f decisions/s, %.0f calls/s\n",
+         latencies.size(), (unsigned long) nb_decisions, total_s,
+         (total_s > 0) ? nb_decisions / total_s : 0.0, (total_s > 0) ? latencies.size() / total_s : 0.0);
+  printf("latency (us) p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+         percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+         percentile(latencies, 0.999), percentile(latencies, 1.0));
+  return ended ? 0 : 1;
+}
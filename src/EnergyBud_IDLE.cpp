@@ -1,287 +1,515 @@
 #include <cstdint>
-#include <list>
-#include <set>
-#include <unordered_map>
+#include <algorithm>
 #include <string>
-#include <sstream>
-#include <batprotocol.hpp>
+#include <vector>
+#include "backfill_verdict.hpp"
 #include "batsim_edc.h"
-#include <iostream>
-using namespace batprotocol;
-
-struct SchedJob {
-    std::string job_id;
-    uint32_t nb_hosts;
-    double walltime;
+#include "edc_config.hpp"
+#include "edc_log.hpp"
+#include "edc_snapshot.hpp"
+#include "sched_engine.hpp"
+
+// Energy is accounted in joules by the engine, and reported in watt-hours
+const double SECONDS_PER_HOUR = 3600.0;
+
+class EnergyBudPolicy : public Policy {
+public:
+    const char* name() const override { return "EnergyBud"; }
+    bool configure(SchedEngine& engine, const nlohmann::json& config) override;
+    void on_simulation_begins(SchedEngine& engine, double now) override;
+    void on_job_submitted(SchedEngine& engine, SchedJob* job, double now) override;
+    void on_job_completed(SchedEngine& engine, SchedJob* job, double now) override;
+    void schedule(SchedEngine& engine, double now) override;
+    void save_state(const SchedEngine& engine, nlohmann::json& state) const override;
+    bool restore_state(SchedEngine& engine, const nlohmann::json& state) override;
+
+private:
+    double estimated_energy(const SchedJob* job) const;
+    double needed_energy(SchedEngine& engine, const SchedJob* job) const;
+    bool has_enough_energy(SchedEngine& engine, const SchedJob* job, double current_time) const;
+    template <bool ENERGY_LIMITED>
+    bool has_enough_energy(SchedEngine& engine, const SchedJob* job, double current_time) const;
+    bool can_backfill(const SchedJob* job, double current_time) const;
+    bool allocate_and_launch(SchedEngine& engine, SchedJob* job, double current_time);
+    void update_reservation(SchedEngine& engine, const SchedJob* job, double current_time);
+    void reserve_for_first_job(SchedEngine& engine, const SchedJob* job, double current_time);
+    void cancel_reservations(SchedEngine& engine);
+    bool try_launch(SchedEngine& engine, SchedJob* job, double current_time);
+    template <bool RESERVED, bool ENERGY_LIMITED, bool SWITCH_OFF>
+    bool try_launch(SchedEngine& engine, SchedJob* job, double current_time);
+    bool scan_queue(SchedEngine& engine, WaitQueue<SchedJob>::iterator first, double current_time);
+    template <bool RESERVED, bool ENERGY_LIMITED, bool SWITCH_OFF>
+    bool scan_queue(SchedEngine& engine, WaitQueue<SchedJob>::iterator first, double current_time);
+    void switch_idle_hosts(SchedEngine& engine, double current_time);
+
+private:
+    // EnergyBud variables
+    double pourcentage_budget = 1.0;
+    double max_energy_budget = 1500.8;          // Wh
+    double energy_budget = max_energy_budget * pourcentage_budget; // recomputed from init data (J)
+    double power_per_host = 203.12;             // P_comp from paper
+    double idle_power_per_host = 100.0;         // P_idle from paper
+    SleepConfig sleep;                          // P_off from paper, see read_sleep_config()
+    bool switch_off = false;                    // Idle hosts the queue cannot use are switched off
+    double break_even_time = EnergyLedger::NEVER; // Shortest idle time worth sleeping
+    double budget_period_duration = 600.0;   // 10 min
+    std::vector<BudgetPeriodConfig> budget_periods; // Calendar of budgets, a single endless period if empty
+
+    // Reservation, its energy is booked in the ledger
+    JobHandle reserved_job = NO_JOB;
+    double reserved_energy_time = 0.0;   // When the reserved job gets its energy
+    double reserved_start_time = 0.0;    // When it also gets its hosts, the shadow time
+    uint32_t reserved_extra_hosts = 0;   // Hosts left at shadow time, usable by longer backfilled jobs
+    uint32_t reserved_woken_hosts = 0;   // Asleep hosts it needs, switched on ahead of shadow time
+    bool reserved_switched_on = false;   // Hosts were switched on for it, they stay awake
+    // Hosts missing to the job with energy that misses the fewest, 0 if none: the free hosts are
+    // then not switched off, and asleep ones are switched on for it
+    uint32_t blocked_hosts = 0;
+    double idle_since = EnergyLedger::NEVER; // Since when free hosts are left unused by the queue
+
+    // Energy needed by the cheapest job blocked by energy only, a new pass runs once it is available
+    double blocked_energy = EnergyLedger::NEVER;
 };
 
-MessageBuilder* mb = nullptr;
-bool format_binary = true;
-std::list<SchedJob*>* jobs = nullptr;
-std::unordered_map<std::string, SchedJob*> running_jobs;
-std::unordered_map<std::string, std::set<uint32_t>> job_allocations;
-uint32_t platform_nb_hosts = 0;
-std::set<uint32_t> available_res;
-
-// EnergyBud variables
-double pourcentage_budget = 1.0;
-double max_energy_budget = 1500.8;
-double energy_budget = max_energy_budget * pourcentage_budget;
-double energy_consumed = 0.0;
-double energy_available = 0.0;
-const double power_per_host = 203.12;       // P_comp from paper
-const double idle_power_per_host = 100.0;   // P_idle from paper
-const double off_power_per_host = 9.75;     // P_off from paper
-const double monitoring_interval = 600.0;   // 10 minutes as in paper  --> not use here
-double last_energy_update_time = 0.0;
-double budget_period_duration = 600.0;   // 10 min
-double budget_start_time = 0.0;
-
-// Reservation
-std::string reserved_job_id = "";
-double reserved_energy = 0.0;
-double reserved_time_end = 0.0;
-double elapsed;
-
-std::string resources_to_str(const std::set<uint32_t>& resources) {
-    std::stringstream ss;
-    for (auto it = resources.begin(); it != resources.end(); ++it) {
-        if (it != resources.begin()) ss << ",";
-        ss << *it;
-    }
-    return ss.str();
+double EnergyBudPolicy::estimated_energy(const SchedJob* job) const {
+    return job->nb_hosts * power_per_host * job->walltime;
 }
 
-double estimated_energy(SchedJob* job) {
-    return job->nb_hosts * power_per_host * (job->walltime / 3600.0);
+// Rule 2: the energy made available while the job runs counts, only the rest is needed at start
+double EnergyBudPolicy::needed_energy(SchedEngine& engine, const SchedJob* job) const {
+    return std::max(0.0, estimated_energy(job) - engine.energy().rate() * job->walltime);
 }
 
-void update_energy(double current_time) {
-    if (budget_start_time == 0.0) {
-        budget_start_time = current_time;
-        last_energy_update_time = current_time;
-        return;
+// ENERGY_LIMITED: the current time is in a budget period, see backfill_verdict.hpp
+template <bool ENERGY_LIMITED>
+bool EnergyBudPolicy::has_enough_energy(SchedEngine& engine, const SchedJob* job, double current_time) const {
+    if constexpr (!ENERGY_LIMITED) {
+        return true; // No energy budget out of the budget periods
+    }
+    if (job->handle == reserved_job) {
+        return reserved_energy_time <= current_time;
     }
+    // The energy must be there now, without delaying the reserved job
+    return engine.energy().earliest_start(needed_energy(engine, job), current_time) <= current_time;
+}
 
-    elapsed = current_time - last_energy_update_time;
-    if (elapsed <= 0) return;
+bool EnergyBudPolicy::has_enough_energy(SchedEngine& engine, const SchedJob* job, double current_time) const {
+    if (!engine.energy().in_window(current_time)) {
+        return has_enough_energy<false>(engine, job, current_time);
+    }
+    return has_enough_energy<true>(engine, job, current_time);
+}
 
-    // Rule 1: Make energy available gradually
-    double energy_released = (energy_budget / budget_period_duration) * elapsed;
-    energy_available += energy_released;
+bool EnergyBudPolicy::can_backfill(const SchedJob* job, double current_time) const {
+    // While a job is reserved: can backfill if job ends before the shadow time,
+    // or if it only uses hosts that the reserved job does not need
+    return (job->handle == reserved_job) ||
+           (current_time + job->walltime <= reserved_start_time) ||
+           (job->nb_hosts <= reserved_extra_hosts);
+}
 
-    // Calculate current power consumption
-    double active_hosts = platform_nb_hosts - available_res.size();
-    double current_power = (active_hosts * power_per_host) + 
-                          (available_res.size() * idle_power_per_host);
+bool EnergyBudPolicy::allocate_and_launch(SchedEngine& engine, SchedJob* job, double current_time) {
+    // Allocate resources
+    if (!engine.launch(job, current_time)) return false;
 
-    // Update energy consumption (convert from watts to watt-hours)
-    double energy_used = current_power * (elapsed / 3600.0);
-    energy_consumed += energy_used;
-    energy_available -= energy_used;
+    if (job->handle == reserved_job) {
+        cancel_reservations(engine);
+    }
 
-    // Ensure we don't go negative on available energy
-    if (energy_available < 0) {
-        energy_available = 0;
+    // A job still running at shadow time uses extra hosts
+    if (reserved_job != NO_JOB && job->handle != reserved_job &&
+        job->expected_end_time > reserved_start_time) {
+        reserved_extra_hosts -= std::min(reserved_extra_hosts, job->nb_hosts);
     }
 
-    last_energy_update_time = current_time;
+    // Deduct energy from available pool
+    engine.energy().debit(estimated_energy(job));
+
+    LOG_DEBUG("[%.1f] Launching job %s on resources %s (energy: %.1f Wh)\n",
+           current_time, job->job_id().c_str(), engine.launched_hosts().c_str(),
+           estimated_energy(job) / SECONDS_PER_HOUR);
+    return true;
 }
 
-bool has_enough_energy(SchedJob* job, double current_time) {
-    // Calculate available energy considering reservations
-    double available = energy_available;
-    if (!reserved_job_id.empty() && reserved_job_id != job->job_id) {
-        available -= reserved_energy;
-    }
-
-    // Rule 2: Ensure enough energy for entire job duration
-    double required_energy = estimated_energy(job);
-    double time_remaining = budget_period_duration - (current_time - budget_start_time);
-    
-    // Calculate maximum energy we could get during job execution
-    double max_possible_energy = available + 
-                               (energy_budget / budget_period_duration) * job->walltime;
-    
-    return (required_energy <= max_possible_energy) && (available >= 0);
+// Computes when the reserved job gets its energy from the ledger, then its hosts from the
+// availability profile, and books its energy at that time
+void EnergyBudPolicy::update_reservation(SchedEngine& engine, const SchedJob* job, double current_time) {
+    EnergyLedger& energy = engine.energy();
+    const AvailabilityProfile& availability = engine.resources().availability();
+    double needed = needed_energy(engine, job);
+    energy.cancel(job->handle); // the job does not wait for its own energy
+    reserved_energy_time = energy.earliest_start(needed, current_time);
+
+    auto reservation = availability.reserve(current_time, job->nb_hosts, 0,
+                                            AvailabilityProfile::NEVER, reserved_energy_time);
+    // The asleep hosts it needs draw the switch-on power instead of the sleep one before it starts
+    if (reservation.woken_hosts > 0) {
+        needed += reservation.woken_hosts * (sleep.switch_on_power() - sleep.off_power) * sleep.switch_on_time;
+        reserved_energy_time = energy.earliest_start(needed, current_time);
+        reservation = availability.reserve(current_time, job->nb_hosts, 0,
+                                           AvailabilityProfile::NEVER, reserved_energy_time);
+    }
+    reserved_start_time = reservation.start;
+    reserved_extra_hosts = reservation.extra_hosts;
+    reserved_woken_hosts = reservation.woken_hosts;
+    if (reserved_start_time < EnergyLedger::NEVER) {
+        energy.reserve(job->handle, reserved_start_time, needed);
+    }
 }
 
-bool can_backfill(SchedJob* job, double current_time) {
-    // Can backfill if job fits before reservation ends or if no reservation exists
-    return (reserved_job_id.empty()) || 
-           (current_time + job->walltime <= reserved_time_end);
+void EnergyBudPolicy::reserve_for_first_job(SchedEngine& engine, const SchedJob* job, double current_time) {
+    reserved_job = job->handle;
+    update_reservation(engine, job, current_time);
+    LOG_DEBUG("[%.1f] Reserved for job %s: %.1f Wh from %.1f (%u extra hosts)\n",
+           current_time, job->job_id().c_str(), needed_energy(engine, job) / SECONDS_PER_HOUR,
+           reserved_start_time, reserved_extra_hosts);
 }
 
-void allocate_and_launch(SchedJob* job, double current_time) {
-    if (available_res.size() < job->nb_hosts) return;
+void EnergyBudPolicy::cancel_reservations(SchedEngine& engine) {
+    if (reserved_job != NO_JOB) {
+        engine.energy().cancel(reserved_job);
+    }
+    reserved_job = NO_JOB;
+    reserved_energy_time = 0.0;
+    reserved_start_time = 0.0;
+    reserved_extra_hosts = 0;
+    reserved_woken_hosts = 0;
+    reserved_switched_on = false;
+}
 
-    // Allocate resources
-    std::set<uint32_t> job_resources;
-    auto it = available_res.begin();
-    for (uint32_t i = 0; i < job->nb_hosts; ++i) {
-        job_resources.insert(*it);
-        it = available_res.erase(it);
+// Launches job if it has hosts and energy, without delaying the reserved job. Instantiated per
+// scan, see backfill_verdict.hpp.
+template <bool RESERVED, bool ENERGY_LIMITED, bool SWITCH_OFF>
+bool EnergyBudPolicy::try_launch(SchedEngine& engine, SchedJob* job, double current_time) {
+    if constexpr (RESERVED) {
+        if (!can_backfill(job, current_time)) {
+            return false;
+        }
     }
+    uint32_t nb_free = engine.resources().nb_free();
+    if (nb_free < job->nb_hosts) {
+        if constexpr (SWITCH_OFF) {
+            uint32_t missing = job->nb_hosts - nb_free;
+            if (job->handle != reserved_job && (blocked_hosts == 0 || missing < blocked_hosts) &&
+                has_enough_energy<ENERGY_LIMITED>(engine, job, current_time)) {
+                blocked_hosts = missing;
+            }
+        }
+        return false;
+    }
+    if (!has_enough_energy<ENERGY_LIMITED>(engine, job, current_time)) {
+        if (job->handle != reserved_job) {
+            blocked_energy = std::min(blocked_energy, needed_energy(engine, job));
+        }
+        return false;
+    }
+    return allocate_and_launch(engine, job, current_time);
+}
 
-    // Update running jobs and allocations
-    running_jobs[job->job_id] = job;
-    job_allocations[job->job_id] = job_resources;
+bool EnergyBudPolicy::try_launch(SchedEngine& engine, SchedJob* job, double current_time) {
+    auto launch = [&](auto reserved, auto energy_limited, auto sleeping) {
+        return try_launch<decltype(reserved)::value, decltype(energy_limited)::value, decltype(sleeping)::value>(
+            engine, job, current_time);
+    };
+    return with_flags(launch, reserved_job != NO_JOB, engine.energy().in_window(current_time), switch_off);
+}
 
-    // Deduct energy from available pool
-    energy_available -= estimated_energy(job);
+// Tries to launch the jobs from first on in FCFS order, except the reserved one.
+// Returns true if any job was launched.
+bool EnergyBudPolicy::scan_queue(SchedEngine& engine, WaitQueue<SchedJob>::iterator first, double current_time) {
+    if (first == engine.jobs().pending().end()) {
+        return false;
+    }
+    // launching the other jobs does not change the reservation
+    auto scan = [&](auto reserved, auto energy_limited, auto sleeping) {
+        return scan_queue<decltype(reserved)::value, decltype(energy_limited)::value, decltype(sleeping)::value>(
+            engine, first, current_time);
+    };
+    return with_flags(scan, reserved_job != NO_JOB, engine.energy().in_window(current_time), switch_off);
+}
 
-    printf("[%.1f] Launching job %s on resources %s (energy: %.1f Wh)\n",
-           current_time, job->job_id.c_str(), resources_to_str(job_resources).c_str(), 
-           estimated_energy(job));
+template <bool RESERVED, bool ENERGY_LIMITED, bool SWITCH_OFF>
+bool EnergyBudPolicy::scan_queue(SchedEngine& engine, WaitQueue<SchedJob>::iterator first, double current_time) {
+    WaitQueue<SchedJob>& jobs = engine.jobs().pending();
+    bool any_launched = false;
+    if (!engine.parallel(jobs.size())) {
+        for (auto it = first; it != jobs.end();) {
+            SchedJob* job = *it++; // launching the job removes it from the queue
+            if (job->handle != reserved_job && try_launch<RESERVED, ENERGY_LIMITED, SWITCH_OFF>(engine, job, current_time)) {
+                any_launched = true;
+            }
+        }
+        return any_launched;
+    }
 
-    mb->add_execute_job(job->job_id, resources_to_str(job_resources));
+    // Very large queue: the jobs that cannot start are filtered out in parallel, against the hosts,
+    // reservation and energy left now. The ones kept are then checked in FCFS order. When hosts
+    // may be switched off, the jobs with energy that wait for hosts only are kept too.
+    QueueArrays& arrays = engine.queue_arrays();
+    size_t first_slot = arrays.index_of((*first)->handle);
+    uint32_t nb_free = engine.resources().nb_free();
+    HostReservation window{current_time, reserved_start_time, reserved_extra_hosts};
+    // see needed_energy()
+    ReducedRateEnergy energy{engine.energy().rate(), QueueArrays::energy_limit(engine.energy().headroom())};
+    const std::vector<uint32_t>& selected = filter_backfill<SWITCH_OFF>(arrays, engine.workers(), first_slot, nb_free,
+                                                                        RESERVED, window, ENERGY_LIMITED, energy);
+
+    // launching the other jobs only takes hosts and energy, so the verdicts hold during the whole scan
+    for (uint32_t slot : selected) {
+        SchedJob* job = arrays.job(slot);
+        if (job == nullptr || job->handle == reserved_job) {
+            continue;
+        }
+        if (arrays.verdict(slot) == QueueArrays::NO_ENERGY) {
+            blocked_energy = std::min(blocked_energy, needed_energy(engine, job));
+            continue;
+        }
+        if (try_launch<RESERVED, ENERGY_LIMITED, SWITCH_OFF>(engine, job, current_time)) {
+            any_launched = true;
+        }
+    }
+    return any_launched;
 }
 
-void reserve_for_first_job(SchedJob* job, double current_time) {
-    reserved_energy = estimated_energy(job);
-    reserved_time_end = current_time + job->walltime;
-    reserved_job_id = job->job_id;
-    printf("[%.1f] Reserved for job %s: %.1f Wh until %.1f\n", 
-           current_time, job->job_id.c_str(), reserved_energy, reserved_time_end);
+// Switches on the asleep hosts the reserved job needs, to be ready at its shadow time, and
+// switches off the free hosts left idle long enough to save energy. The ones the reserved job
+// needs sleep until its energy comes, if that is far enough. The others are idle for an unknown
+// time: they sleep once they have been idle for the break-even time, which wastes at most as much
+// energy as the best choice would save.
+void EnergyBudPolicy::switch_idle_hosts(SchedEngine& engine, double current_time) {
+    const ResourceIndex& resources = engine.resources();
+    if (reserved_job != NO_JOB && reserved_woken_hosts > 0 && reserved_start_time < EnergyLedger::NEVER) {
+        double wake_time = reserved_start_time - sleep.switch_on_time;
+        if (wake_time > current_time) {
+            engine.request_wakeup(wake_time, current_time);
+        } else if (engine.switch_on(reserved_woken_hosts, current_time) > 0) {
+            reserved_switched_on = true;
+            update_reservation(engine, engine.jobs().pending().find(reserved_job), current_time);
+        }
+    }
+
+    // A job with energy waiting for hosts only gets the asleep ones it misses, the free ones stay awake
+    if (blocked_hosts > resources.nb_switching_on() &&
+        blocked_hosts <= resources.nb_switching_on() + resources.nb_asleep()) {
+        engine.switch_on(blocked_hosts - resources.nb_switching_on(), current_time);
+    }
+    uint32_t nb_idle = (blocked_hosts > 0 || break_even_time == EnergyLedger::NEVER) ? 0 : resources.nb_free();
+
+    // The reserved job may take its hosts earlier than its shadow time if it waits for running jobs,
+    // which often end before their walltime, so they only sleep when it waits for energy. Once woken,
+    // they stay awake even if their power delays its energy: switching them off again would waste
+    // the transitions.
+    uint32_t nb_reserved = 0;
+    if (reserved_job != NO_JOB && reserved_start_time < EnergyLedger::NEVER) {
+        nb_reserved = nb_idle - std::min(nb_idle, reserved_extra_hosts);
+    }
+    uint32_t nb_off = 0;
+    if (nb_reserved > 0 && !reserved_switched_on && reserved_energy_time >= reserved_start_time &&
+        reserved_start_time - current_time >= break_even_time) {
+        nb_off = nb_reserved;
+    }
+
+    uint32_t nb_unused = nb_idle - nb_reserved;
+    if (nb_unused == 0) {
+        idle_since = EnergyLedger::NEVER;
+    } else if (idle_since == EnergyLedger::NEVER) {
+        idle_since = current_time;
+    }
+    if (nb_unused > 0 && idle_since + break_even_time <= current_time) {
+        nb_off += nb_unused;
+        idle_since = EnergyLedger::NEVER;
+    } else if (nb_unused > 0) {
+        engine.request_wakeup(idle_since + break_even_time, current_time);
+    }
+
+    if (nb_off == 0) {
+        return;
+    }
+    engine.switch_off(nb_off, current_time);
+    if (reserved_job != NO_JOB) {
+        update_reservation(engine, engine.jobs().pending().find(reserved_job), current_time);
+    }
+    LOG_DEBUG("[%.1f] %u hosts switched off, %u sleeping\n", current_time, nb_off, resources.nb_sleeping());
 }
 
-void cancel_reservations() {
-    reserved_job_id = "";
-    reserved_energy = 0.0;
-    reserved_time_end = 0.0;
+// Policy parameters, see edc_config.hpp
+bool EnergyBudPolicy::configure(SchedEngine& engine, const nlohmann::json& config) {
+    if (!read_config_value(config, "budget_percentage", pourcentage_budget) ||
+        !read_config_value(config, "max_energy_budget", max_energy_budget) ||
+        !read_config_value(config, "p_comp_est", power_per_host) ||
+        !read_config_value(config, "p_idle_est", idle_power_per_host) ||
+        !read_config_value(config, "period_length", budget_period_duration) ||
+        !read_budget_periods_config(config, budget_periods) ||
+        !read_sleep_config(config, switch_off, sleep)) {
+        return false;
+    }
+    if (budget_period_duration <= 0) {
+        LOG_ERROR("Invalid period_length %g, it must be positive.\n", budget_period_duration);
+        return false;
+    }
+    energy_budget = max_energy_budget * pourcentage_budget * SECONDS_PER_HOUR;
+
+    // Rule 1: Make energy available gradually, the platform consumption is taken from it
+    engine.resources().set_host_power(power_per_host, idle_power_per_host);
+    if (switch_off) {
+        engine.resources().set_sleep(sleep);
+    }
+    if (budget_periods.empty()) {
+        engine.energy().set_rate(energy_budget / budget_period_duration);
+    } else {
+        // Each period releases its fraction of the max budget of a period_length one
+        std::vector<EnergyLedger::Period> periods;
+        double max_rate = max_energy_budget * SECONDS_PER_HOUR / budget_period_duration;
+        for (const BudgetPeriodConfig& period : budget_periods) {
+            periods.push_back({period.start, period.end, period.budget_percentage * max_rate});
+        }
+        engine.energy().set_periods(std::move(periods));
+    }
+    engine.energy().set_debit_consumption(true);
+    return true;
 }
 
-uint8_t batsim_edc_init(const uint8_t* data, uint32_t size, uint32_t flags) {
-    format_binary = ((flags & BATSIM_EDC_FORMAT_BINARY) != 0);
-    mb = new MessageBuilder(!format_binary);
-    jobs = new std::list<SchedJob*>();
-    return 0;
+void EnergyBudPolicy::on_simulation_begins(SchedEngine& engine, double now) {
+    cancel_reservations(engine);
+    // With the powers of the platform, jobs are estimated at the mean power of its hosts
+    if (engine.platform_power()) {
+        power_per_host = engine.resources().host_powers().mean_computing_power(1);
+    }
+    if (switch_off && engine.nb_hosts() > 0) {
+        break_even_time = sleep.break_even_time(engine.resources().host_powers().total_idle_power() / engine.nb_hosts());
+    }
+    LOG_INFO("[%.1f] Platform initialized with %d hosts\n",
+           now, engine.nb_hosts());
 }
 
-uint8_t batsim_edc_deinit() {
-    delete mb;
-    if (jobs) {
-        for (auto* job : *jobs) delete job;
-        delete jobs;
-    }
-    running_jobs.clear();
-    job_allocations.clear();
-    return 0;
+void EnergyBudPolicy::on_job_submitted(SchedEngine& engine, SchedJob* job, double now) {
+    (void) engine;
+    job->estimated_energy = estimated_energy(job);
+    LOG_DEBUG("[%.1f] Job %s submitted (%d hosts, %.1fs)\n",
+           now, job->job_id().c_str(),
+           job->nb_hosts, job->walltime);
 }
 
-uint8_t batsim_edc_take_decisions(
-    const uint8_t* what_happened,
-    uint32_t what_happened_size,
-    uint8_t** decisions,
-    uint32_t* decisions_size) {
+void EnergyBudPolicy::on_job_completed(SchedEngine& engine, SchedJob* job, double now) {
+    (void) engine;
+    LOG_DEBUG("[%.1f] Job %s completed\n", now, job->job_id().c_str());
+}
 
-    auto* parsed = deserialize_message(*mb, !format_binary, what_happened);
-    double current_time = parsed->now();
-    mb->clear(current_time);
-
-    for (unsigned int i = 0; i < parsed->events()->size(); ++i) {
-        auto event = (*parsed->events())[i];
-        switch (event->event_type()) {
-            case fb::Event_BatsimHelloEvent:
-                mb->add_edc_hello("EnergyBud", "1.0.0");
-                break;
-
-            case fb::Event_SimulationBeginsEvent: {
-                auto simu_begins = event->event_as_SimulationBeginsEvent();
-                platform_nb_hosts = simu_begins->computation_host_number();
-                available_res.clear();
-                for (uint32_t i = 0; i < platform_nb_hosts; i++) {
-                    available_res.insert(i);
-                }
-                printf("[%.1f] Platform initialized with %d hosts\n", 
-                       current_time, platform_nb_hosts);
-            } break;
-            
-            case fb::Event_JobSubmittedEvent: {
-                auto parsed_job = event->event_as_JobSubmittedEvent();
-                auto job = new SchedJob{
-                    parsed_job->job_id()->str(),
-                    static_cast<uint8_t>(parsed_job->job()->resource_request()), // FIX: avoid warning narrowing
-                    parsed_job->job()->walltime(),
-
-                    
-                };
-                if (job->nb_hosts > platform_nb_hosts) {
-                    mb->add_reject_job(job->job_id);
-                    delete job;
-                } else {
-                    jobs->push_back(job);
-                    printf("[%.1f] Job %s submitted (%d hosts, %.1fs)\n",
-                           current_time, job->job_id.c_str(),
-                           job->nb_hosts, job->walltime);
-                }
-            } break;
-            
-            case fb::Event_JobCompletedEvent: {
-                auto job_id = event->event_as_JobCompletedEvent()->job_id()->str();
-                if (running_jobs.count(job_id)) {
-                    for (uint32_t host : job_allocations[job_id]) {
-                        available_res.insert(host);
-                    }
-                    running_jobs.erase(job_id);
-                    job_allocations.erase(job_id);
-                    printf("[%.1f] Job %s completed\n", current_time, job_id.c_str());
-                }
-                if (job_id == reserved_job_id) {
-                    cancel_reservations();
-                }
-            } break;
-            
-            default: break;
-        }
+void EnergyBudPolicy::schedule(SchedEngine& engine, double current_time) {
+    WaitQueue<SchedJob>& jobs = engine.jobs().pending();
+    const ResourceIndex& resources = engine.resources();
+
+    // Running jobs may have ended before their walltime, and the platform power changed:
+    // refresh the reservation
+    double previous_start_time = reserved_start_time;
+    uint32_t previous_extra_hosts = reserved_extra_hosts;
+    if (reserved_job != NO_JOB) {
+        update_reservation(engine, jobs.find(reserved_job), current_time);
     }
 
-    update_energy(current_time);
+    // If only jobs were submitted, the ones queued before are as blocked as in the previous pass:
+    // the scans start from the first new job. Unless the reservation moved, e.g. once the jobs
+    // launched by the previous pass took their energy.
+    SchedJob* first_submitted = engine.first_submitted();
+    bool resume = engine.changes() == SchedEngine::JOBS_SUBMITTED &&
+                  first_submitted != nullptr && first_submitted != jobs.front() &&
+                  reserved_start_time == previous_start_time && reserved_extra_hosts == previous_extra_hosts;
+    auto first_scanned = [&]() {
+        return resume ? jobs.iterator_to(first_submitted->handle) : jobs.begin();
+    };
+    if (!resume) {
+        blocked_energy = EnergyLedger::NEVER;
+        blocked_hosts = 0;
+    }
 
-    // 1. try to run all possible jobs
-    for (auto it = jobs->begin(); it != jobs->end();) {
-        SchedJob* job = *it;
-        if (available_res.size() >= job->nb_hosts && has_enough_energy(job, current_time)) {
-            allocate_and_launch(job, current_time);
-            it = jobs->erase(it);
-        } else {
-            ++it;
-        }
+    // 1. try to run all possible jobs, without delaying the reserved one, which heads the queue
+    if (reserved_job != NO_JOB && try_launch(engine, jobs.find(reserved_job), current_time)) {
+        resume = false;
+    }
+    if (scan_queue(engine, first_scanned(), current_time)) {
+        resume = false; // the first new job may be gone, the next scan covers the whole queue
     }
 
     // 2. if first job blocked, reserve and try to run it
-    if (!jobs->empty() && reserved_job_id.empty()) {
-        SchedJob* first_job = jobs->front();
-        reserve_for_first_job(first_job, current_time);
-
-        if (available_res.size() >= first_job->nb_hosts && has_enough_energy(first_job, current_time)) {
-            jobs->pop_front();
-            allocate_and_launch(first_job, current_time);
-            cancel_reservations();
+    if (!jobs.empty() && reserved_job == NO_JOB) {
+        SchedJob* first_job = jobs.front();
+        reserve_for_first_job(engine, first_job, current_time);
+
+        if (resources.nb_free() >= first_job->nb_hosts && has_enough_energy(engine, first_job, current_time)) {
+            allocate_and_launch(engine, first_job, current_time);
         }
     }
 
     // 3. try backfilling
-    if (!reserved_job_id.empty()) {
-        for (auto it = jobs->begin(); it != jobs->end();) {
-            SchedJob* job = *it;
-            if (job->job_id != reserved_job_id &&
-                available_res.size() >= job->nb_hosts &&
-                has_enough_energy(job, current_time) &&
-                can_backfill(job, current_time)) {
-                allocate_and_launch(job, current_time);
-                it = jobs->erase(it);
-            } else {
-                ++it;
-            }
+    if (reserved_job != NO_JOB) {
+        scan_queue(engine, first_scanned(), current_time);
+    }
+    engine.set_energy_threshold(jobs.empty() ? EnergyLedger::NEVER : blocked_energy);
+
+    // 4. the idle hosts no pending job can use sleep, the reservation wakes the ones it needs
+    if (switch_off) {
+        switch_idle_hosts(engine, current_time);
+    }
+
+    // 5. no event may come before the reserved job has its energy: ask Batsim to call back then
+    if (reserved_job != NO_JOB && reserved_energy_time > current_time &&
+        reserved_energy_time < EnergyLedger::NEVER) {
+        engine.request_wakeup(reserved_energy_time, current_time);
+    }
+
+    LOG_INFO("[%.1f] Status: %lu jobs queued, %lu/%d hosts free, Energy: %.1f/%.1f Wh (reserved: %.1f)\n",
+           current_time, jobs.size(), (unsigned long) resources.nb_free(), engine.nb_hosts(),
+           engine.energy().available() / SECONDS_PER_HOUR, energy_budget / SECONDS_PER_HOUR,
+           engine.energy().reserved() / SECONDS_PER_HOUR);
+}
+
+// The reservation, the idle hosts and the jobs blocked by the previous pass
+void EnergyBudPolicy::save_state(const SchedEngine& engine, nlohmann::json& state) const {
+    const SchedJob* job = engine.jobs().get(reserved_job);
+    state = {
+        {"reserved_job", (job != nullptr) ? nlohmann::json(job->id) : nlohmann::json(nullptr)},
+        {"reserved_energy_time", double_to_json(reserved_energy_time)},
+        {"reserved_start_time", double_to_json(reserved_start_time)},
+        {"reserved_extra_hosts", reserved_extra_hosts},
+        {"reserved_woken_hosts", reserved_woken_hosts},
+        {"reserved_switched_on", reserved_switched_on},
+        {"idle_since", double_to_json(idle_since)},
+        {"blocked_hosts", blocked_hosts},
+        {"blocked_energy", double_to_json(blocked_energy)},
+    };
+}
+
+bool EnergyBudPolicy::restore_state(SchedEngine& engine, const nlohmann::json& state) {
+    const nlohmann::json& job = state.at("reserved_job");
+    if (!job.is_null()) {
+        reserved_job = engine.jobs().handle_of(job.get<std::string>());
+        if (engine.jobs().pending().find(reserved_job) == nullptr) {
+            return false; // the reserved job waits at the head of the queue
         }
     }
+    reserved_energy_time = double_from_json(state.at("reserved_energy_time"));
+    reserved_start_time = double_from_json(state.at("reserved_start_time"));
+    state.at("reserved_extra_hosts").get_to(reserved_extra_hosts);
+    state.at("reserved_woken_hosts").get_to(reserved_woken_hosts);
+    state.at("reserved_switched_on").get_to(reserved_switched_on);
+    idle_since = double_from_json(state.at("idle_since"));
+    state.at("blocked_hosts").get_to(blocked_hosts);
+    blocked_energy = double_from_json(state.at("blocked_energy"));
+    return true;
+}
+
+uint8_t batsim_edc_init(const uint8_t* data, uint32_t size, uint32_t flags) {
+    return edc_init([]() -> Policy * { return new EnergyBudPolicy(); }, data, size, flags);
+}
 
-    printf("[%.1f] Status: %lu jobs queued, %lu/%d hosts free, Energy: %.1f/%.1f Wh (reserved: %.1f)\n",
-           current_time, jobs->size(), available_res.size(), platform_nb_hosts,
-           energy_available, energy_budget, reserved_energy);
+uint8_t batsim_edc_deinit() {
+    return edc_deinit();
+}
 
-    mb->finish_message(current_time);
-    serialize_message(*mb, !format_binary, const_cast<const uint8_t**>(decisions), decisions_size);
-    return 0;
+uint8_t batsim_edc_take_decisions(
+    const uint8_t* what_happened,
+    uint32_t what_happened_size,
+    uint8_t** decisions,
+    uint32_t* decisions_size) {
+    return edc_take_decisions(what_happened, what_happened_size, decisions, decisions_size);
 }
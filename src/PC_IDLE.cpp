@@ -1,235 +1,245 @@
 //Premier code
 
 #include <cstdint>
-#include <list>
-#include <set>
-#include <unordered_map>
-#include <batprotocol.hpp>
+#include <string>
+#include "backfill_verdict.hpp"
 #include "batsim_edc.h"
-
-using namespace batprotocol;
-
-struct SchedJob {
-    std::string job_id;
-    uint8_t nb_hosts;
-    double walltime; // Durée estimée d'exécution
-};  
-
-MessageBuilder * mb = nullptr;
-bool format_binary = true;
-std::list<SchedJob*> * jobs = nullptr;
-std::unordered_map<std::string, SchedJob*> running_jobs;
-std::unordered_map<std::string, std::set<uint32_t>> job_allocations;
-uint32_t platform_nb_hosts = 0;
-std::set<uint32_t> available_res;
-double shadow_time = 0.0; // Temps maximum où le premier job peut être retardé
-
-double P_IDLE_M = 100.0, P_COMP_M = 203.12, P_IDLE_A = 95, P_COMP_A = 190.74;
-double ENERGY_BUDGET = 0;
-double PERIOD_LENGTH = 600;  // 10 Min
-double power_limit = 0 ;
-double pourcentage_budget = 1.0; //100% pour le moment 
-double current_power = 0;
-
-// Initialisation
-uint8_t batsim_edc_init(const uint8_t * data, uint32_t size, uint32_t flags) {
-    format_binary = ((flags & BATSIM_EDC_FORMAT_BINARY) != 0);
-    if ((flags & (BATSIM_EDC_FORMAT_BINARY | BATSIM_EDC_FORMAT_JSON)) != flags) {
-        printf("Unknown flags used, cannot initialize myself.\n");
-        return 1;
+#include "edc_config.hpp"
+#include "edc_log.hpp"
+#include "edc_snapshot.hpp"
+#include "sched_engine.hpp"
+
+// PC_IDLE : EASY backfilling sous un plafond de puissance
+class PCIdlePolicy : public Policy {
+public:
+    const char * name() const override { return "easy_backfill"; }
+    bool configure(SchedEngine & engine, const nlohmann::json & config) override;
+    void on_simulation_begins(SchedEngine & engine, double now) override;
+    void on_job_submitted(SchedEngine & engine, SchedJob * job, double now) override;
+    void on_job_completed(SchedEngine & engine, SchedJob * job, double now) override;
+    void schedule(SchedEngine & engine, double now) override;
+    void save_state(const SchedEngine & engine, nlohmann::json & state) const override;
+    bool restore_state(SchedEngine & engine, const nlohmann::json & state) override;
+
+private:
+    template <typename Power>
+    void schedule_with(SchedEngine & engine, double now, const Power & power);
+
+    double shadow_time = 0.0; // Date à laquelle le premier job pourra démarrer (hôtes et puissance)
+    uint32_t extra_hosts = 0; // Machines encore libres à shadow_time une fois le premier job lancé
+    double extra_power = 0.0; // Puissance encore disponible à shadow_time une fois le premier job lancé
+    BackfillPacker packer;    // Backfilling par anticipation, désactivé par défaut
+
+    double P_IDLE_M = 100.0, P_COMP_M = 203.12, P_IDLE_A = 95, P_COMP_A = 190.74;
+    double ENERGY_BUDGET = 0;
+    double PERIOD_LENGTH = 600;  // 10 Min
+    double power_limit = 0 ;
+    double pourcentage_budget = 1.0; //100% pour le moment
+};
+
+// Paramètres de la politique, voir edc_config.hpp
+bool PCIdlePolicy::configure(SchedEngine & engine, const nlohmann::json & config) {
+    if (!read_config_value(config, "budget_percentage", pourcentage_budget) ||
+        !read_config_value(config, "p_comp", P_COMP_M) ||
+        !read_config_value(config, "p_idle", P_IDLE_M) ||
+        !read_config_value(config, "p_comp_est", P_COMP_A) ||
+        !read_config_value(config, "p_idle_est", P_IDLE_A) ||
+        !read_config_value(config, "period_length", PERIOD_LENGTH) ||
+        !read_lookahead_config(config, packer)) {
+        return false;
     }
 
-    mb = new MessageBuilder(!format_binary);
-    jobs = new std::list<SchedJob*>();
-
-    return 0;
+    // Consommation estimée de la plateforme, tenue à jour par le moteur
+    engine.resources().set_host_power(P_COMP_A, P_IDLE_A);
+    return true;
 }
 
-// Nettoyage mémoire en fin de simulation
-uint8_t batsim_edc_deinit() {
-    delete mb;
-    mb = nullptr;
+void PCIdlePolicy::on_simulation_begins(SchedEngine & engine, double now) {
+    (void) now;
+    LOG_INFO("nb machines %d\n", engine.nb_hosts());
+
+    // Avec les puissances de la plateforme, le budget est une part de sa puissance maximale
+    double max_power = engine.platform_power() ? engine.resources().host_powers().total_computing_power()
+                                               : engine.nb_hosts() * P_COMP_M;
+    ENERGY_BUDGET = max_power * pourcentage_budget; //3 jour en seconde = 259200
+    power_limit = ENERGY_BUDGET;  // PERIOD_LENGTH;
+    // Seule la puissance limite les jobs : les lancer ne dépend pas de l'énergie disponible
+    engine.set_energy_threshold(EnergyLedger::NEVER);
+    LOG_INFO("conso de base at beginning = %lf , power limit = %lf \n",engine.resources().power(),power_limit);
+}
 
-    if (jobs != nullptr) {
-        for (auto * job : *jobs) {
-            delete job;
-        }
-        delete jobs;
-        jobs = nullptr;
-    }
+void PCIdlePolicy::on_job_submitted(SchedEngine & engine, SchedJob * job, double now) {
+    (void) now;
+    double con = engine.resources().power_increase(job->nb_hosts);
+    LOG_DEBUG("conso de base du job = %lf \n",con);
+}
 
-    running_jobs.clear();
-    job_allocations.clear();
-    return 0;
+void PCIdlePolicy::on_job_completed(SchedEngine & engine, SchedJob * job, double now) {
+    (void) job; (void) now;
+    LOG_DEBUG("conso after finishing a job = %lf \n",engine.resources().power());
 }
 
-// Gestion des décisions
-uint8_t batsim_edc_take_decisions(
-    const uint8_t * what_happened,
-    uint32_t what_happened_size,
-    uint8_t ** decisions,
-    uint32_t * decisions_size)
-{
-    (void) what_happened_size;
-    auto * parsed = deserialize_message(*mb, !format_binary, what_happened);
-    mb->clear(parsed->now());
-
-    auto nb_events = parsed->events()->size();
-    for (unsigned int i = 0; i < nb_events; ++i) {
-        auto event = (*parsed->events())[i];
-        printf("easy_backfill received event type='%s'\n", batprotocol::fb::EnumNamesEvent()[event->event_type()]);
-
-        switch (event->event_type()) {
-            case fb::Event_BatsimHelloEvent: {
-                mb->add_edc_hello("easy_backfill", "1.0.0");
-            } break;
-
-            case fb::Event_SimulationBeginsEvent: {
-                auto simu_begins = event->event_as_SimulationBeginsEvent();
-                platform_nb_hosts = simu_begins->computation_host_number();
-                printf("nb machines %d", platform_nb_hosts);
-                
-                // Init des ressources disponibles
-                for (uint32_t i = 0; i < platform_nb_hosts; i++) {
-                    available_res.insert(i);
-                }
-                current_power = platform_nb_hosts * P_IDLE_A;
-                ENERGY_BUDGET = platform_nb_hosts * P_COMP_M * pourcentage_budget; //3 jour en seconde = 259200
-                power_limit = ENERGY_BUDGET;  // PERIOD_LENGTH;
-            printf("conso de base at beginning = %lf , power limit = %lf \n",current_power,power_limit);
-            } break;
-
-            case fb::Event_JobSubmittedEvent: {
-                auto parsed_job = event->event_as_JobSubmittedEvent();
-                auto job = new SchedJob();
-                job->job_id = parsed_job->job_id()->str();
-                job->nb_hosts = parsed_job->job()->resource_request();
-                job->walltime = parsed_job->job()->walltime(); // Récupération du walltime
-
-                if (job->nb_hosts > platform_nb_hosts) {
-                    mb->add_reject_job(job->job_id);
-                    delete job;
-                } else {
-                    jobs->push_back(job);
-                    if (jobs->size() == 1) {
-                        shadow_time = job->walltime; // Premier job : son temps de walltime est le temps limite
-                    }
-                    double con = job->nb_hosts * (P_COMP_A -P_IDLE_A);
-                    printf("conso de base du job = %lf \n",con);
-                }
-            } break;
+// Gestion des décisions, avec le modèle de puissance des machines (voir backfill_verdict.hpp)
+void PCIdlePolicy::schedule(SchedEngine & engine, double now) {
+    const HostPowerTable & powers = engine.resources().host_powers();
+    if (powers.uniform()) {
+        schedule_with(engine, now, UniformPower(powers));
+    } else {
+        schedule_with(engine, now, HostTablePower(powers));
+    }
+}
 
-            case fb::Event_JobCompletedEvent: {
-                auto parsed_job = event->event_as_JobCompletedEvent();
-                std::string completed_job_id = parsed_job->job_id()->str();
+template <typename Power>
+void PCIdlePolicy::schedule_with(SchedEngine & engine, double now, const Power & power) {
+    WaitQueue<SchedJob> & jobs = engine.jobs().pending();
+    const ResourceIndex & resources = engine.resources();
+
+    // Si seuls des jobs ont été soumis, les jobs déjà en file restent bloqués comme au passage
+    // précédent : le backfilling reprend au premier nouveau job
+    SchedJob* first_submitted = engine.first_submitted();
+    bool resume = engine.changes() == SchedEngine::JOBS_SUBMITTED &&
+                  first_submitted != nullptr && first_submitted != jobs.front();
+
+    // EASY : lancer les premiers jobs de la file tant qu'ils tiennent (machines et puissance)
+    uint32_t nb_launched = 0;
+    uint32_t nb_backfilled = 0;
+    while (!jobs.empty()) {
+        SchedJob* first_job = jobs.front();
+        double soon_power = resources.power() + resources.power_increase(power, first_job->nb_hosts);
+        if (soon_power > power_limit) {
+            LOG_DEBUG("this job %s ask too musch energy %lf over %lf \n", first_job->job_id().c_str(), soon_power, power_limit);
+            break;
+        }
+        if (!engine.launch(first_job, now)) {
+            break;
+        }
 
-                if (running_jobs.count(completed_job_id)) {
-                    SchedJob* completed_job = running_jobs[completed_job_id];
+        LOG_DEBUG("Assigning first job %s to resources: %s and has a conso of %lf new power : %lf over total %lf\n",
+        first_job->job_id().c_str(), engine.launched_hosts().c_str(),soon_power,resources.power(),power_limit);
+        ++nb_launched;
+    }
 
-                    // Libération des ressources
-                    for (uint32_t host : job_allocations[completed_job_id]) {
-                        available_res.insert(host);
-                    }
+    // BACKFILLING : remplir toutes les machines libres sans retarder le premier de la file
+    if (!jobs.empty() && resources.nb_free() > 0) {
+        SchedJob* first_job = jobs.front();
+
+        // Réservation EASY du premier job : date où assez de machines et de puissance seront libérées
+        auto reservation = resources.reserve(now, first_job->nb_hosts, power_limit);
+        shadow_time = reservation.start;
+        extra_hosts = reservation.extra_hosts;
+        extra_power = reservation.extra_power;
+
+        auto try_backfill = [&](SchedJob* backfill_candidate) {
+            // Le job doit finir avant shadow_time, ou n'utiliser que les machines et la puissance en trop
+            double backfill_increase = resources.power_increase(power, backfill_candidate->nb_hosts);
+            double backfill_power = resources.power() + backfill_increase;
+            bool ends_before_shadow = now + backfill_candidate->walltime <= shadow_time;
+            bool fits_in_extra = backfill_candidate->nb_hosts <= extra_hosts && backfill_increase <= extra_power;
+            if (backfill_power > power_limit) {
+                LOG_DEBUG("this job %s ask too musch energy %lf over %lf \n", backfill_candidate->job_id().c_str(), backfill_power, power_limit);
+                return;
+            }
 
-                    current_power = available_res.size() * P_IDLE_A + (platform_nb_hosts - available_res.size()) * P_COMP_A;
-                    printf("conso after finishing a job = %lf \n",current_power);
-                    running_jobs.erase(completed_job_id);
-                    job_allocations.erase(completed_job_id);
-                    delete completed_job;
+            if ((ends_before_shadow || fits_in_extra) &&
+                resources.nb_free() >= backfill_candidate->nb_hosts &&
+                engine.launch(backfill_candidate, now)) {
+                if (!ends_before_shadow) {
+                    extra_hosts -= backfill_candidate->nb_hosts;
+                    extra_power -= backfill_increase;
                 }
-            } break;
 
-            default: break;
-        }
-    }
-
-    // BACKFILLING : Exécuter les jobs sans retarder le premier de la file
-    if (!jobs->empty()) {
-        SchedJob* first_job = jobs->front();
-        std::set<uint32_t> job_resources;
-        double soon_power = current_power + first_job->nb_hosts * (P_COMP_A - P_IDLE_A);
-        bool first_job_can_run = false;
-        if(available_res.size() >= first_job->nb_hosts && soon_power <= power_limit){
-            first_job_can_run = true;
-        }
-        if(soon_power>power_limit){
-            printf("this job %s ask too musch energy %lf over %lf \n", first_job->job_id.c_str(), soon_power, power_limit);
-        }
-        for (auto it = std::next(jobs->begin()); it != jobs->end(); ++it) {
-            SchedJob* backfill_candidate = *it;
-            double backfill_power = current_power + backfill_candidate->nb_hosts * (P_COMP_A - P_IDLE_A);
-            if (available_res.size() >= backfill_candidate->nb_hosts && backfill_candidate->walltime <= shadow_time && backfill_power <= power_limit ){ 
-                std::set<uint32_t> job_resources;
-                auto res_it = available_res.begin();
-                for (uint8_t i = 0; i < backfill_candidate->nb_hosts; ++i, ++res_it) {
-                    job_resources.insert(*res_it);
-                }
-            
-                bool resources_available = true;
-                for (uint32_t res : job_resources) {
-                    if (available_res.find(res) == available_res.end()) {
-                        resources_available = false;
-                        break;
-                    }
-                }
-                current_power = available_res.size() * P_IDLE_A + (platform_nb_hosts - available_res.size()) * P_COMP_A;
-                if (resources_available && backfill_power <= power_limit) {
-                    // Allouer les ressources
-                    for (uint32_t res : job_resources) {
-                        available_res.erase(res);
-                    }
-                    current_power = backfill_power; 
-
-                    running_jobs[backfill_candidate->job_id] = backfill_candidate;
-                    job_allocations[backfill_candidate->job_id] = job_resources;
-            
-                    std::string resources_str;
-                    for (auto it = job_resources.begin(); it != job_resources.end(); ++it) {
-                        if (it != job_resources.begin()) resources_str += ",";
-                        resources_str += std::to_string(*it);
-                    }
-            
-                    printf("Backfilling job %s to resources: %s and has a conso of %lf new power : %lf over total %lf\n",
-                    backfill_candidate->job_id.c_str(), resources_str.c_str(),backfill_power,current_power,power_limit);
-                    mb->add_execute_job(backfill_candidate->job_id, resources_str);
-                    jobs->erase(it);
-                    break;
+                LOG_DEBUG("Backfilling job %s to resources: %s and has a conso of %lf new power : %lf over total %lf\n",
+                backfill_candidate->job_id().c_str(), engine.launched_hosts().c_str(),backfill_power,resources.power(),power_limit);
+                ++nb_launched;
+                ++nb_backfilled;
+            }
+        };
+
+        // Anticipation : parmi les premiers candidats qui tiennent seuls, lancer ensemble ceux qui
+        // occupent le plus de machines sous le plafond. Aucun des candidats vus ne tient plus ensuite :
+        // le glouton complète à partir des suivants.
+        auto start = (resume && nb_launched == 0) ? jobs.iterator_to(first_submitted->handle) : std::next(jobs.begin());
+        if (packer.enabled()) {
+            packer.clear();
+            auto it = start;
+            for (; it != jobs.end() && !packer.full(); ++it) {
+                SchedJob* candidate = *it;
+                double increase = resources.power_increase(power, candidate->nb_hosts);
+                bool late = now + candidate->walltime > shadow_time;
+                if (candidate->nb_hosts <= resources.nb_free() && resources.power() + increase <= power_limit &&
+                    (!late || (candidate->nb_hosts <= extra_hosts && increase <= extra_power))) {
+                    packer.add(candidate, increase, late);
                 }
             }
-            if(backfill_power>power_limit){
-                printf("this job %s ask too musch energy %lf over %lf \n", backfill_candidate->job_id.c_str(), soon_power, power_limit);
+            if (packer.solve({resources.nb_free(), power_limit - resources.power(), extra_hosts, extra_power})) {
+                for (SchedJob* job : packer.picked()) {
+                    try_backfill(job);
+                }
+                start = it;
+            } else {
+                LOG_DEBUG("lookahead over %zu jobs ran out of time, greedy backfilling\n", packer.size());
             }
         }
 
-        // Si aucune exécution en backfilling, exécuter le premier job
-        if (first_job_can_run) {
-            auto it = available_res.begin();
-            for (uint8_t i = 0; i < first_job->nb_hosts; ++i, ++it) {
-                job_resources.insert(*it);
-            }
-            for (uint32_t res : job_resources) {
-                available_res.erase(res);
+        if (!resume && engine.parallel(jobs.size())) {
+            // Très longue file : les jobs qui ne peuvent pas démarrer sont écartés en parallèle, d'après
+            // les machines et la puissance libres maintenant. Les autres sont revus dans l'ordre de la file.
+            // la puissance limite toujours les jobs, et le premier job est toujours réservé
+            QueueArrays& arrays = engine.queue_arrays();
+            size_t first = (start == jobs.end()) ? arrays.size() : arrays.index_of((*start)->handle);
+            const std::vector<uint32_t>& selected = filter_backfill(arrays, engine.workers(), first, resources.nb_free(),
+                true, PowerReservation{now, shadow_time, extra_hosts, extra_power},
+                true, PowerCap<Power>{power, resources.power(), power_limit});
+            for (size_t i = 0; i < selected.size() && resources.nb_free() > 0; ++i) {
+                if (arrays.job(selected[i]) != nullptr) {
+                    try_backfill(arrays.job(selected[i]));
+                }
             }
-            current_power = soon_power;
-            running_jobs[first_job->job_id] = first_job;
-            job_allocations[first_job->job_id] = job_resources;
-
-            std::string resources_str;
-            for (auto it = job_resources.begin(); it != job_resources.end(); ++it) {
-                if (it != job_resources.begin()) resources_str += ",";
-                resources_str += std::to_string(*it);
+        } else {
+            for (auto it = start; it != jobs.end() && resources.nb_free() > 0;) {
+                try_backfill(*it++); // lancer le job le retire de la file
             }
-
-            printf("Assigning first job %s to resources: %s and has a conso of %lf new power : %lf over total %lf\n",
-            first_job->job_id.c_str(), resources_str.c_str(),soon_power,current_power,power_limit);
-            mb->add_execute_job(first_job->job_id, resources_str);
-            jobs->pop_front();
         }
     }
 
-    mb->finish_message(parsed->now());
-    serialize_message(*mb, !format_binary, const_cast<const uint8_t **>(decisions), decisions_size);
-    return 0;
+    if (nb_launched > 0) {
+        LOG_INFO("[%.1f] %u jobs launched this round (%u backfilled), %zu pending, power %lf over %lf\n",
+               now, nb_launched, nb_backfilled, jobs.size(), resources.power(), power_limit);
+    }
+}
+
+// La réservation du premier job, dont dépendent les passages qui reprennent aux nouveaux jobs
+void PCIdlePolicy::save_state(const SchedEngine & engine, nlohmann::json & state) const {
+    (void) engine;
+    state = {{"shadow_time", double_to_json(shadow_time)}, {"extra_hosts", extra_hosts},
+             {"extra_power", double_to_json(extra_power)}};
+}
+
+bool PCIdlePolicy::restore_state(SchedEngine & engine, const nlohmann::json & state) {
+    (void) engine;
+    shadow_time = double_from_json(state.at("shadow_time"));
+    state.at("extra_hosts").get_to(extra_hosts);
+    extra_power = double_from_json(state.at("extra_power"));
+    return true;
+}
+
+// Initialisation
+uint8_t batsim_edc_init(const uint8_t * data, uint32_t size, uint32_t flags) {
+    return edc_init([]() -> Policy * { return new PCIdlePolicy(); }, data, size, flags);
+}
+
+// Nettoyage mémoire en fin de simulation
+uint8_t batsim_edc_deinit() {
+    return edc_deinit();
+}
+
+uint8_t batsim_edc_take_decisions(
+    const uint8_t * what_happened,
+    uint32_t what_happened_size,
+    uint8_t ** decisions,
+    uint32_t * decisions_size)
+{
+    return edc_take_decisions(what_happened, what_happened_size, decisions, decisions_size);
 }
 /*The second one is a powercapped EASY Backfilling. A power limit
 is set during the whole energy budget period, which is set to
@@ -239,4 +249,4 @@ nidle × P̃idle + ncomp × P̃comp , where nidle is the number
 of idle nodes and ncomp is the number of nodes which are
 computing jobs. This algorithm is roughly the same as EASY
 Backfilling, but jobs are not executed if they cause P̃platf orm
-to be greater than the power limit.*/
\ No newline at end of file
+to be greater than the power limit.*/
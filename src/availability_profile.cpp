@@ -0,0 +1,107 @@
+#include "availability_profile.hpp"
+
+#include <algorithm>
+
+void AvailabilityProfile::reset(uint32_t nb_hosts, double base_power) {
+  _releases.clear();
+  _nb_hosts = nb_hosts;
+  _free_hosts = nb_hosts;
+  _asleep_hosts = 0;
+  _power = base_power;
+}
+
+void AvailabilityProfile::set_wake(double delay, double power) {
+  _wake_delay = delay;
+  _wake_power = power;
+}
+
+void AvailabilityProfile::sleep_hosts(uint32_t nb_hosts) {
+  _free_hosts -= nb_hosts;
+  _asleep_hosts += nb_hosts;
+}
+
+void AvailabilityProfile::wake_hosts(uint32_t nb_hosts) {
+  _asleep_hosts -= nb_hosts;
+  _free_hosts += nb_hosts;
+}
+
+void AvailabilityProfile::add_job(double expected_end, uint32_t nb_hosts, double power) {
+  Release & release = _releases[expected_end];
+  release.nb_hosts += nb_hosts;
+  release.power += power;
+  release.nb_jobs += 1;
+
+  _free_hosts -= nb_hosts;
+  _power += power;
+}
+
+void AvailabilityProfile::remove_job(double expected_end, uint32_t nb_hosts, double power) {
+  auto it = _releases.find(expected_end);
+  if (it == _releases.end()) {
+    return;
+  }
+
+  Release & release = it->second;
+  release.nb_hosts -= nb_hosts;
+  release.power -= power;
+  release.nb_jobs -= 1;
+  if (release.nb_jobs == 0) {
+    _releases.erase(it);
+  }
+
+  _free_hosts += nb_hosts;
+  _power -= power;
+}
+
+uint32_t AvailabilityProfile::free_hosts_at(double time) const {
+  uint32_t free_hosts = _free_hosts;
+  for (auto it = _releases.begin(); it != _releases.end() && it->first <= time; ++it) {
+    free_hosts += it->second.nb_hosts;
+  }
+  return free_hosts;
+}
+
+double AvailabilityProfile::power_at(double time) const {
+  double power = _power;
+  for (auto it = _releases.begin(); it != _releases.end() && it->first <= time; ++it) {
+    power -= it->second.power;
+  }
+  return power;
+}
+
+AvailabilityProfile::Reservation AvailabilityProfile::reserve(double now, uint32_t nb_hosts, double power,
+                                                              double power_limit, double not_before) const {
+  double start = std::max(now, not_before);
+  uint32_t free_hosts = _free_hosts;
+  double platform_power = _power;
+
+  // everything released before the earliest possible start is available at start
+  auto it = _releases.begin();
+  for (; it != _releases.end() && it->first <= start; ++it) {
+    free_hosts += it->second.nb_hosts;
+    platform_power -= it->second.power;
+  }
+
+  // then wait for enough releases, or for the asleep hosts once switched on
+  uint32_t woken_hosts = 0;
+  double wake_time = now + _wake_delay;
+  while (free_hosts < nb_hosts || platform_power + power > power_limit) {
+    if (woken_hosts == 0 && free_hosts < nb_hosts && _asleep_hosts > 0 &&
+        (it == _releases.end() || it->first > std::max(start, wake_time))) {
+      start = std::max(start, wake_time);
+      woken_hosts = std::min(_asleep_hosts, nb_hosts - free_hosts);
+      free_hosts += woken_hosts;
+      platform_power += woken_hosts * _wake_power;
+      continue;
+    }
+    if (it == _releases.end()) {
+      return {NEVER, 0, 0, 0};
+    }
+    start = it->first;
+    free_hosts += it->second.nb_hosts;
+    platform_power -= it->second.power;
+    ++it;
+  }
+
+  return {start, free_hosts - nb_hosts, power_limit - platform_power - power, woken_hosts};
+}
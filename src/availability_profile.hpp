@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+
+/**
+ * @brief Future availability of the platform: when hosts get free and how the power draw decreases.
+ * @details Running jobs are recorded by their expected end time, so launching or completing
+ *          a job is a single O(log n) map update, and the profile is walked in time order to find
+ *          the EASY backfilling reservation (shadow time and extra hosts) of the first pending job.
+ */
+class AvailabilityProfile {
+public:
+  static constexpr double NEVER = std::numeric_limits<double>::infinity();
+
+  // What EASY backfilling needs to know about the reservation of the first pending job
+  struct Reservation {
+    double start;         // Shadow time: earliest time the job can start, NEVER if it cannot
+    uint32_t extra_hosts; // Hosts still free at start once the job started
+    double extra_power;   // Power headroom left at start once the job started (W)
+    uint32_t woken_hosts; // Asleep hosts the job needs, to be switched on at start - wake delay
+  };
+
+  // Starts with nb_hosts free hosts and a platform drawing base_power (W)
+  void reset(uint32_t nb_hosts, double base_power);
+
+  // A job starts on nb_hosts hosts and adds power (W) to the platform until expected_end
+  void add_job(double expected_end, uint32_t nb_hosts, double power);
+  // The job previously given to add_job() with the same arguments is over
+  void remove_job(double expected_end, uint32_t nb_hosts, double power);
+
+  // nb_hosts free hosts go to sleep, or asleep ones are free again. Hosts switching on are free
+  // hosts added as a job ending when they are ready.
+  void sleep_hosts(uint32_t nb_hosts);
+  void wake_hosts(uint32_t nb_hosts);
+  // The power of the platform changes by power (W) for good, e.g. once hosts switched pstate
+  void add_power(double power) { _power += power; }
+  // Asleep hosts are ready delay (s) after being switched on, and then add power (W) each
+  void set_wake(double delay, double power);
+
+  uint32_t nb_hosts() const { return _nb_hosts; }
+  uint32_t free_hosts() const { return _free_hosts; }
+  uint32_t asleep_hosts() const { return _asleep_hosts; }
+  double power() const { return _power; }
+
+  // Free hosts and power draw at a future time, assuming running jobs end as expected
+  uint32_t free_hosts_at(double time) const;
+  double power_at(double time) const;
+
+  /**
+   * @brief Computes the reservation of a job that needs nb_hosts hosts and adds power to the platform.
+   * @param[in] now The current time, releases expected in the past are considered immediate.
+   * @param[in] not_before The reservation cannot start earlier, e.g. for lack of energy.
+   * @param[in] power_limit The platform power must stay within this limit once the job started.
+   * @details Asleep hosts count once switched on now, if the job needs them.
+   */
+  Reservation reserve(double now, uint32_t nb_hosts, double power = 0, double power_limit = NEVER,
+                      double not_before = 0) const;
+
+private:
+  struct Release {
+    uint32_t nb_hosts = 0;
+    double power = 0;
+    uint32_t nb_jobs = 0;
+  };
+
+  std::map<double, Release> _releases; // by expected end time
+  uint32_t _nb_hosts = 0;
+  uint32_t _free_hosts = 0;
+  uint32_t _asleep_hosts = 0;
+  double _power = 0;
+  double _wake_delay = 0;
+  double _wake_power = 0;
+};
@@ -0,0 +1,59 @@
+#include "backfill_packer.hpp"
+
+bool BackfillPacker::solve(const BackfillPacker::Capacity & capacity) {
+  _picked.clear();
+  size_t nb_items = _items.size();
+  _capacity = capacity;
+  _hosts_after.assign(nb_items + 1, 0);
+  for (size_t i = nb_items; i-- > 0;) {
+    _hosts_after[i] = _hosts_after[i + 1] + _items[i].nb_hosts;
+  }
+  _taken.assign(nb_items, false);
+  _best_taken.assign(nb_items, false);
+  _best_hosts = 0;
+  _nb_nodes = 0;
+  _deadline = std::chrono::steady_clock::now() + _time_budget;
+
+  if (!search(0, 0, 0.0, 0, 0.0)) {
+    return false;
+  }
+  for (size_t i = 0; i < nb_items; ++i) {
+    if (_best_taken[i]) {
+      _picked.push_back(_items[i].job);
+    }
+  }
+  return true;
+}
+
+bool BackfillPacker::search(size_t item, uint32_t hosts, double cost, uint32_t late_hosts, double late_cost) {
+  // the clock is read every few nodes only
+  if ((++_nb_nodes & 255) == 0 && std::chrono::steady_clock::now() > _deadline) {
+    return false;
+  }
+
+  if (hosts > _best_hosts) {
+    _best_hosts = hosts;
+    _best_taken = _taken;
+  }
+  // nothing left to add can beat the best subset, or the free hosts are all used
+  if (item == _items.size() || hosts + _hosts_after[item] <= _best_hosts || _best_hosts == _capacity.hosts) {
+    return true;
+  }
+
+  // with the candidate first, so that the first subset explored is the greedy one
+  const Item & candidate = _items[item];
+  if (hosts + candidate.nb_hosts <= _capacity.hosts && cost + candidate.cost <= _capacity.cost &&
+      (!candidate.late || (late_hosts + candidate.nb_hosts <= _capacity.late_hosts &&
+                           late_cost + candidate.cost <= _capacity.late_cost))) {
+    _taken[item] = true;
+    bool completed = candidate.late
+        ? search(item + 1, hosts + candidate.nb_hosts, cost + candidate.cost,
+                 late_hosts + candidate.nb_hosts, late_cost + candidate.cost)
+        : search(item + 1, hosts + candidate.nb_hosts, cost + candidate.cost, late_hosts, late_cost);
+    _taken[item] = false;
+    if (!completed) {
+      return false;
+    }
+  }
+  return search(item + 1, hosts, cost, late_hosts, late_cost);
+}
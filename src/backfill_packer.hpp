@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "job_store.hpp"
+
+/**
+ * @brief Lookahead backfilling: among the first candidates of a scan, picks the subset that uses
+ *        the most hosts within the free hosts and the power (or energy) headroom.
+ * @details A bounded 2-D knapsack, solved exactly by branch and bound. Jobs running past the
+ *          reservation of the first job (late ones) must also fit in the hosts and power it leaves
+ *          free when it starts. Jobs come in the order of the greedy scan, which breaks ties, and
+ *          the first solution explored is the greedy one.
+ *
+ *          The search stops when time_budget runs out: solve() then fails and the policy falls back
+ *          to its greedy scan. On uniform platforms powers are proportional to the number of hosts of
+ *          the jobs, so using the most hosts also uses the most power. On heterogeneous ones the cost
+ *          of each job is the one of the hosts it would get alone, and the jobs picked are checked
+ *          again as they are launched.
+ */
+class BackfillPacker {
+public:
+  // Room left for the candidates
+  struct Capacity {
+    uint32_t hosts;      // Free hosts
+    double cost;         // Power (or energy) headroom
+    uint32_t late_hosts; // Hosts left to the late jobs by the reservation
+    double late_cost;    // Power left to the late jobs by the reservation
+  };
+
+  // Most candidates given to a solve(), the search is exponential in their number
+  static constexpr size_t MAX_WINDOW = 64;
+
+  // Number of candidates considered per scan, 0 disables the lookahead
+  void set_window(size_t window) { _window = window; }
+  void set_time_budget(std::chrono::microseconds budget) { _time_budget = budget; }
+  bool enabled() const { return _window > 0; }
+
+  void clear() { _items.clear(); }
+  // Adds a candidate that fits on its own, in the order of the greedy scan
+  void add(SchedJob * job, double cost, bool late) { _items.push_back({job, job->nb_hosts, cost, late}); }
+  bool full() const { return _items.size() >= _window; }
+  size_t size() const { return _items.size(); }
+
+  /**
+   * @brief Searches the subset of the candidates that uses the most hosts within capacity.
+   * @return False if the time budget ran out before the search completed.
+   */
+  bool solve(const Capacity & capacity);
+  // Candidates of the best subset, in the order they were added
+  const std::vector<SchedJob *> & picked() const { return _picked; }
+
+private:
+  struct Item {
+    SchedJob * job;
+    uint32_t nb_hosts;
+    double cost;
+    bool late;
+  };
+
+  // Explores the subsets of the candidates from item on, false once the time budget ran out
+  bool search(size_t item, uint32_t hosts, double cost, uint32_t late_hosts, double late_cost);
+
+private:
+  size_t _window = 0;
+  std::chrono::microseconds _time_budget{1000};
+  std::vector<Item> _items;
+  std::vector<SchedJob *> _picked;
+
+  // Current search
+  Capacity _capacity{};
+  std::vector<uint32_t> _hosts_after; // Hosts of the candidates from an item on, to bound the search
+  std::vector<bool> _taken, _best_taken;
+  uint32_t _best_hosts = 0;
+  uint64_t _nb_nodes = 0;
+  std::chrono::steady_clock::time_point _deadline;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "host_power.hpp"
+#include "queue_arrays.hpp"
+#include "worker_pool.hpp"
+
+// Backfill scans composed at compile time from the policy types. Whether a job is reserved, whether
+// energy is limited, whether hosts may be switched off and the power model of the hosts do not
+// change during a scan: each combination is its own instantiation, selected once per scan, whose
+// loop over the queue tests none of them per job. The verdicts of the parallel filters (see
+// QueueArrays::filter()) are composed from the reservation window and energy accounting of a
+// policy and selected by filter_backfill(). The sequential scans of the policies take the flags
+// from with_flags(), and the power models from host_power.hpp.
+
+// Energy accounting: the cost of a job, and whether it lacks it. The cost is also the one of
+// the power headroom of the reservation windows.
+struct UnlimitedEnergy {
+  double cost(uint32_t, double, double) const { return 0; }
+  bool lacks(double) const { return false; }
+};
+// reducePC: the estimated energy of the job must be within the headroom of the ledger
+struct EnergyHeadroom {
+  double limit; // see QueueArrays::energy_limit()
+
+  double cost(uint32_t, double, double energy) const { return energy; }
+  bool lacks(double cost) const { return cost > limit; }
+};
+// EnergyBud: only the energy not made available at rate (W) while the job runs must be within it
+struct ReducedRateEnergy {
+  double rate;
+  double limit;
+
+  double cost(uint32_t, double walltime, double energy) const { return std::max(0.0, energy - rate * walltime); }
+  bool lacks(double cost) const { return cost > limit; }
+};
+// PC_IDLE: the power the job adds must keep the platform under the cap. The hosts are not chosen
+// yet, so the smallest increase of any of them, from a power model of host_power.hpp.
+template <typename Power>
+struct PowerCap {
+  Power model;
+  double power;
+  double limit;
+
+  double cost(uint32_t nb_hosts, double, double) const { return model.min_increase(nb_hosts); }
+  bool lacks(double cost) const { return power + cost > limit; }
+};
+
+// Reservation windows of EASY backfilling: whether a job would delay the reserved one
+struct NoReservation {
+  bool blocks(uint32_t, double, double) const { return false; }
+};
+// Jobs still running at shadow_time may only use the extra hosts
+struct HostReservation {
+  double now;
+  double shadow_time;
+  uint32_t extra_hosts;
+
+  bool blocks(uint32_t nb_hosts, double walltime, double) const {
+    return now + walltime > shadow_time && nb_hosts > extra_hosts;
+  }
+};
+// and the extra power (W)
+struct PowerReservation {
+  double now;
+  double shadow_time;
+  uint32_t extra_hosts;
+  double extra_power;
+
+  bool blocks(uint32_t nb_hosts, double walltime, double increase) const {
+    return now + walltime > shadow_time && (nb_hosts > extra_hosts || increase > extra_power);
+  }
+};
+
+/**
+ * @brief Verdict of a backfill candidate, given the hosts free at the start of the scan.
+ * @details Jobs that would delay the reservation or do not fit are dropped, the ones that fit but
+ *          lack energy are NO_ENERGY. With KEEP_HOST_BLOCKED, the jobs with energy that only lack
+ *          hosts are kept, e.g. to wake asleep hosts for them.
+ */
+template <typename Window, typename Energy, bool KEEP_HOST_BLOCKED>
+struct BackfillVerdict {
+  uint32_t nb_free;
+  Window window;
+  Energy energy;
+
+  QueueArrays::Verdict operator()(uint32_t nb_hosts, double walltime, double job_energy) const {
+    double cost = energy.cost(nb_hosts, walltime, job_energy);
+    bool no_hosts = (nb_hosts > nb_free);
+    if ((no_hosts && !KEEP_HOST_BLOCKED) || window.blocks(nb_hosts, walltime, cost)) {
+      return QueueArrays::DROP;
+    }
+    bool no_energy = energy.lacks(cost);
+    if (no_hosts) {
+      return no_energy ? QueueArrays::DROP : QueueArrays::KEEP;
+    }
+    return no_energy ? QueueArrays::NO_ENERGY : QueueArrays::KEEP;
+  }
+};
+
+/**
+ * @brief Filters the jobs of arrays from slot first on, in parallel on pool: the window only
+ *        applies if reserved, and the energy accounting if energy_limited.
+ * @return See QueueArrays::filter().
+ */
+template <bool KEEP_HOST_BLOCKED = false, typename Window, typename Energy>
+const std::vector<uint32_t> & filter_backfill(QueueArrays & arrays, WorkerPool & pool, size_t first, uint32_t nb_free,
+                                              bool reserved, const Window & window,
+                                              bool energy_limited, const Energy & energy) {
+  if (reserved && energy_limited) {
+    return arrays.filter(pool, first, BackfillVerdict<Window, Energy, KEEP_HOST_BLOCKED>{nb_free, window, energy});
+  }
+  if (reserved) {
+    return arrays.filter(pool, first, BackfillVerdict<Window, UnlimitedEnergy, KEEP_HOST_BLOCKED>{nb_free, window, {}});
+  }
+  if (energy_limited) {
+    return arrays.filter(pool, first, BackfillVerdict<NoReservation, Energy, KEEP_HOST_BLOCKED>{nb_free, {}, energy});
+  }
+  return arrays.filter(pool, first, BackfillVerdict<NoReservation, UnlimitedEnergy, KEEP_HOST_BLOCKED>{nb_free, {}, {}});
+}
+
+/**
+ * @brief Calls f with a std::bool_constant for each of flags, see above.
+ */
+template <typename F>
+decltype(auto) with_flags(F && f) {
+  return f();
+}
+template <typename F, typename... Flags>
+decltype(auto) with_flags(F && f, bool flag, Flags... flags) {
+  if (flag) {
+    return with_flags([&](auto... constants) -> decltype(auto) { return f(std::true_type{}, constants...); }, flags...);
+  }
+  return with_flags([&](auto... constants) -> decltype(auto) { return f(std::false_type{}, constants...); }, flags...);
+}
@@ -0,0 +1,63 @@
+#include "decision_stats.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "edc_log.hpp"
+
+void DecisionStats::enable(const std::string & path, Format format, size_t capacity) {
+  _path = path;
+  _format = format;
+  _records.assign(capacity, Record());
+  _nb_calls = 0;
+}
+
+DecisionStats::Record & DecisionStats::next_record() {
+  Record & record = _records[_nb_calls % _records.size()];
+  ++_nb_calls;
+  record = Record();
+  return record;
+}
+
+bool DecisionStats::dump() const {
+  if (!enabled()) {
+    return true;
+  }
+
+  FILE * file = fopen(_path.c_str(), "w");
+  if (file == nullptr) {
+    LOG_ERROR("Cannot write decision statistics to '%s'\n", _path.c_str());
+    return false;
+  }
+
+  // the oldest kept call comes first
+  uint64_t nb_kept = (_nb_calls < _records.size()) ? _nb_calls : _records.size();
+  uint64_t first = _nb_calls - nb_kept;
+
+  if (_format == Format::CSV) {
+    fprintf(file, "call,now,deserialize_ns,events_ns,schedule_ns,serialize_ns,nb_events,queue_length,nb_launched\n");
+  } else {
+    fprintf(file, "{\"nb_calls\": %" PRIu64 ", \"calls\": [", _nb_calls);
+  }
+
+  for (uint64_t call = first; call < _nb_calls; ++call) {
+    const Record & r = _records[call % _records.size()];
+    if (_format == Format::CSV) {
+      fprintf(file, "%" PRIu64 ",%.17g,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%u,%u,%u\n",
+              call, r.now, r.deserialize_ns, r.events_ns, r.schedule_ns, r.serialize_ns,
+              r.nb_events, r.queue_length, r.nb_launched);
+    } else {
+      fprintf(file, "%s\n  {\"call\": %" PRIu64 ", \"now\": %.17g, \"deserialize_ns\": %" PRIu64
+              ", \"events_ns\": %" PRIu64 ", \"schedule_ns\": %" PRIu64 ", \"serialize_ns\": %" PRIu64
+              ", \"nb_events\": %u, \"queue_length\": %u, \"nb_launched\": %u}",
+              (call == first) ? "" : ",", call, r.now, r.deserialize_ns, r.events_ns, r.schedule_ns,
+              r.serialize_ns, r.nb_events, r.queue_length, r.nb_launched);
+    }
+  }
+
+  if (_format == Format::JSON) {
+    fprintf(file, "\n]}\n");
+  }
+  fclose(file);
+  return true;
+}
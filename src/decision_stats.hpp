@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Per-call measurements of batsim_edc_take_decisions(), kept in a ring buffer.
+ * @details Recording is disabled by default and then costs a branch per call. Once enabled,
+ *          the last capacity calls are kept in a preallocated buffer, so that recording never
+ *          allocates, and they are written to a CSV or JSON file when the component is
+ *          deinitialized. Durations are wall-clock nanoseconds.
+ */
+class DecisionStats {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  enum class Format { CSV, JSON };
+
+  // Measurements of a call
+  struct Record {
+    double now = 0;              // Simulation time of the call
+    uint64_t deserialize_ns = 0; // Reading the received message
+    uint64_t events_ns = 0;      // Handling its events
+    uint64_t schedule_ns = 0;    // Taking the decisions of the policy
+    uint64_t serialize_ns = 0;   // Writing the decisions
+    uint32_t nb_events = 0;
+    uint32_t queue_length = 0;   // Pending jobs once the decisions are taken
+    uint32_t nb_launched = 0;    // Jobs launched by the call
+  };
+
+  // Starts recording the last capacity calls, to be written to path
+  void enable(const std::string & path, Format format, size_t capacity);
+  bool enabled() const { return !_records.empty(); }
+
+  // Slot of the measurements of a new call, overwriting the oldest one once the buffer is full
+  Record & next_record();
+  // Number of calls recorded so far, some of which may have been overwritten
+  uint64_t nb_calls() const { return _nb_calls; }
+
+  static uint64_t elapsed_ns(Clock::time_point from, Clock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+  }
+
+  // Writes the kept calls, from the oldest one, to the file given to enable(). Returns false on error.
+  bool dump() const;
+
+private:
+  std::vector<Record> _records; // Ring buffer, empty when disabled
+  uint64_t _nb_calls = 0;
+  std::string _path;
+  Format _format = Format::CSV;
+};
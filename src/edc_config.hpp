@@ -0,0 +1,503 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "backfill_packer.hpp"
+#include "decision_stats.hpp"
+#include "edc_log.hpp"
+#include "energy_ledger.hpp"
+#include "online_metrics.hpp"
+#include "resource_index.hpp"
+#include "walltime_predictor.hpp"
+
+// Policy parameters are given to the decision components as a JSON object,
+// passed through Batsim's command line as the initialization data of the library:
+//   batsim -l ./build/libPC_IDLE.so 0 '{"budget_percentage": 0.5}' -p ... -w ...
+//
+// Every key is optional, a missing key keeps the policy default.
+//   budget_percentage  fraction of the maximum energy budget (1.0 is 100%)
+//   p_comp, p_idle     power of a computing/idle host (W) used to size the maximum budget
+//   p_comp_est         estimated power of a computing host (W)
+//   p_idle_est         estimated power of an idle host (W)
+//   period_length      length of the energy budget period (s)
+//   budget_periods     calendar of budget periods replacing the single budget_percentage one:
+//                      a list of {"start", "end", "budget_percentage"} objects (s), sorted and
+//                      disjoint. No energy budget applies out of the periods.
+//   carry_over         energy left at the end of a period: "all" (default), "none" or "fraction"
+//   carry_over_fraction  part of the energy left that is kept with "fraction" (default 1)
+//   contiguous_fallback  reducePC only: allocate fragmented hosts when no contiguous block fits (default true)
+//   max_energy_budget  EnergyBud only: energy budget of the period at 100% (Wh)
+//   log_level          off, error, warning, info (default) or debug, see edc_log.hpp
+//   stats_file         file to which per-call timings are written at deinitialization, none by default
+//   stats_format       csv (default) or json
+//   stats_capacity     number of last calls kept (default 65536)
+//   metrics_file       file to which the utilization, energy and slowdown of the simulation are
+//                      written at deinitialization as a JSON object, none by default. The energy is
+//                      normalized by p_comp (default 203.12).
+//   parallel_threshold queue length (for reducePC, candidates of its previous scan) from which the
+//                      candidate jobs of a scan are filtered in parallel (default 16384)
+//   parallel_workers   threads of the parallel filters besides the scheduling one (default 3),
+//                      0 disables them
+//   platform_power     read the computing and idle power of each host from its wattage_per_state
+//                      property at simulation start (default false), the hosts without one keep
+//                      p_comp_est and p_idle_est. Budgets are then sized from these powers.
+//   lookahead_jobs     PC_IDLE and reducePC: number of backfill candidates packed together to use
+//                      the most hosts under the power (energy) headroom, 0 (default) for greedy
+//                      backfilling only, at most 64
+//   lookahead_time_us  time budget of the lookahead per pass (default 1000), greedy backfilling
+//                      is used when it runs out
+//   switch_off         EnergyBud only: switch the idle hosts the queue cannot use to sleep_pstate,
+//                      and back to awake_pstate ahead of the reservation needing them (default false)
+//   awake_pstate, sleep_pstate  Batsim pstates of the hosts awake (default 0) and asleep (default 1)
+//   p_off_est          estimated power of a sleeping host (W, default 9.75)
+//   switch_off_time, switch_on_time  duration of the transitions of a host (s, default 0), at least
+//                      the ones of the platform
+//   switch_off_energy, switch_on_energy  energy a host takes during each transition (J, default 0)
+//   snapshot_file      file to which the state of the component is written as JSON at the end of the
+//                      first call at or after snapshot_time (s, default 0), none by default.
+//                      See edc_snapshot.hpp.
+//   restore_file       snapshot the component resumes from instead of waiting for the simulation to
+//                      begin, none by default. The simulator must resume from its time too, e.g.
+//                      edc_replay --restore, Batsim always starts from time 0. The other keys may
+//                      differ from the ones of the snapshot run, e.g. to compare budgets from then on.
+//   walltime_correction  schedule the jobs with walltimes corrected from the runtimes of the completed
+//                      jobs of their size class instead of the requested ones (default false), see
+//                      WalltimePredictor. Jobs are still killed at their requested walltime.
+//   walltime_quantile  quantile of the runtime to requested walltime ratios the walltimes are
+//                      corrected to (default 0.9)
+//   walltime_min_samples  completed jobs of a size class before its walltimes are corrected (default 20)
+//   walltime_decay     weight kept by a ratio with each later one of its class (default 0.99)
+//   partitions         partitions of the platform, scheduled independently by their own policy, queue,
+//                      resource index and energy ledger: a list of {"name", "hosts", "config"} objects.
+//                      hosts is a list of host ids such as "0-63,128-191", config the keys of the
+//                      partition that differ from the other ones, e.g. its budget_percentage. A job
+//                      goes to the partition named as its workload (the part of its id before '!'),
+//                      or else to the partition it fits in with the least pending work per host.
+//                      Budgets and powers of each partition are the ones of its hosts. None by default,
+//                      snapshots are only supported then.
+//   partition_property host property naming the partition of each host, instead of the hosts of the
+//                      partitions. The hosts of no listed partition are left unused.
+
+/**
+ * @brief Parses the batsim_edc_init() initialization data as a JSON object.
+ * @details An empty buffer is valid and yields an empty object.
+ * @param[in] data The initialization data, not necessarily NULL-terminated.
+ * @param[in] size The size of the initialization data.
+ * @param[out] config The parsed object.
+ * @return True if and only if the data is empty or a valid JSON object.
+ */
+inline bool parse_edc_config(const uint8_t * data, uint32_t size, nlohmann::json & config) {
+  config = nlohmann::json::object();
+  if (data == nullptr || size == 0) {
+    return true;
+  }
+
+  std::string text(reinterpret_cast<const char *>(data), size);
+  if (text.find_first_not_of(" \t\r\n") == std::string::npos) {
+    return true;
+  }
+
+  try {
+    config = nlohmann::json::parse(text);
+  } catch (const nlohmann::json::exception & e) {
+    LOG_ERROR("Invalid initialization data, expected a JSON object: %s\n", e.what());
+    return false;
+  }
+
+  if (!config.is_object()) {
+    LOG_ERROR("Invalid initialization data, expected a JSON object but got '%s'\n", text.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Overwrites value with config[key] if the key is present.
+ * @return False if the key is present but has an incompatible type.
+ */
+template <typename T>
+bool read_config_value(const nlohmann::json & config, const char * key, T & value) {
+  auto it = config.find(key);
+  if (it == config.end()) {
+    return true;
+  }
+
+  try {
+    value = it->get<T>();
+  } catch (const nlohmann::json::exception & e) {
+    LOG_ERROR("Invalid value for configuration key '%s': %s\n", key, e.what());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Sets the runtime log level from the log_level key if it is present.
+ * @return False if the key is present but is not a known level.
+ */
+inline bool read_log_level_config(const nlohmann::json & config) {
+  std::string level;
+  if (!read_config_value(config, "log_level", level)) {
+    return false;
+  }
+  return level.empty() || set_edc_log_level(level.c_str());
+}
+
+// A period of the budget_periods key, whose budget is a fraction of the policy maximum budget
+struct BudgetPeriodConfig {
+  double start = 0;
+  double end = EnergyLedger::NEVER;
+  double budget_percentage = 1.0;
+};
+
+/**
+ * @brief Reads the calendar of budget periods from the budget_periods key if it is present.
+ * @param[out] periods The periods, left empty if the key is missing.
+ * @return False if the key is present but is not a list of sorted and disjoint periods.
+ */
+inline bool read_budget_periods_config(const nlohmann::json & config, std::vector<BudgetPeriodConfig> & periods) {
+  periods.clear();
+  auto it = config.find("budget_periods");
+  if (it == config.end()) {
+    return true;
+  }
+  if (!it->is_array()) {
+    LOG_ERROR("Invalid value for configuration key 'budget_periods': expected a list of periods\n");
+    return false;
+  }
+
+  for (const nlohmann::json & entry : *it) {
+    BudgetPeriodConfig period;
+    if (!entry.is_object() ||
+        !read_config_value(entry, "start", period.start) ||
+        !read_config_value(entry, "end", period.end) ||
+        !read_config_value(entry, "budget_percentage", period.budget_percentage)) {
+      LOG_ERROR("Invalid budget period '%s'\n", entry.dump().c_str());
+      return false;
+    }
+    if (period.end <= period.start || period.budget_percentage < 0 ||
+        (!periods.empty() && period.start < periods.back().end)) {
+      LOG_ERROR("Invalid budget period '%s': periods must be non-empty, sorted and disjoint\n",
+                entry.dump().c_str());
+      return false;
+    }
+    periods.push_back(period);
+  }
+  return true;
+}
+
+/**
+ * @brief Sets the carry-over policy of ledger from the carry_over and carry_over_fraction keys.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_carry_over_config(const nlohmann::json & config, EnergyLedger & ledger) {
+  std::string carry_over = "all";
+  double fraction = 1.0;
+  if (!read_config_value(config, "carry_over", carry_over) ||
+      !read_config_value(config, "carry_over_fraction", fraction)) {
+    return false;
+  }
+  if (fraction < 0 || fraction > 1) {
+    LOG_ERROR("Invalid carry_over_fraction %g, it must be within [0, 1].\n", fraction);
+    return false;
+  }
+
+  if (carry_over == "all") {
+    ledger.set_carry_over(EnergyLedger::CarryOver::ALL);
+  } else if (carry_over == "none") {
+    ledger.set_carry_over(EnergyLedger::CarryOver::NONE);
+  } else if (carry_over == "fraction") {
+    ledger.set_carry_over(EnergyLedger::CarryOver::FRACTION, fraction);
+  } else {
+    LOG_ERROR("Unknown carry_over '%s', expected all, none or fraction.\n", carry_over.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Enables the per-call statistics from the stats_file, stats_format and stats_capacity keys
+ *        if stats_file is present.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_stats_config(const nlohmann::json & config, DecisionStats & stats) {
+  std::string path;
+  std::string format = "csv";
+  size_t capacity = 65536;
+  if (!read_config_value(config, "stats_file", path) ||
+      !read_config_value(config, "stats_format", format) ||
+      !read_config_value(config, "stats_capacity", capacity)) {
+    return false;
+  }
+  if (format != "csv" && format != "json") {
+    LOG_ERROR("Unknown stats_format '%s', expected csv or json.\n", format.c_str());
+    return false;
+  }
+  if (capacity == 0) {
+    LOG_ERROR("Invalid stats_capacity 0, it must be positive.\n");
+    return false;
+  }
+
+  if (!path.empty()) {
+    stats.enable(path, (format == "json") ? DecisionStats::Format::JSON : DecisionStats::Format::CSV, capacity);
+  }
+  return true;
+}
+
+/**
+ * @brief Enables the summary of the simulation metrics from the metrics_file key, normalized
+ *        by the p_comp one, if metrics_file is present.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_metrics_config(const nlohmann::json & config, OnlineMetrics & metrics) {
+  std::string path;
+  double max_host_power = 203.12;
+  if (!read_config_value(config, "metrics_file", path) ||
+      !read_config_value(config, "p_comp", max_host_power)) {
+    return false;
+  }
+
+  if (!path.empty()) {
+    metrics.enable(path, max_host_power);
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the parallel_threshold and parallel_workers keys of the parallel candidate filters.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_parallel_config(const nlohmann::json & config, size_t & threshold, unsigned & nb_workers) {
+  if (!read_config_value(config, "parallel_threshold", threshold) ||
+      !read_config_value(config, "parallel_workers", nb_workers)) {
+    return false;
+  }
+  if (nb_workers > 64) {
+    LOG_ERROR("Invalid parallel_workers %u, at most 64 are supported.\n", nb_workers);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Sets up the lookahead backfilling of packer from the lookahead_jobs and
+ *        lookahead_time_us keys.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_lookahead_config(const nlohmann::json & config, BackfillPacker & packer) {
+  size_t window = 0;
+  int64_t time_budget = 1000;
+  if (!read_config_value(config, "lookahead_jobs", window) ||
+      !read_config_value(config, "lookahead_time_us", time_budget)) {
+    return false;
+  }
+  if (window > BackfillPacker::MAX_WINDOW) {
+    LOG_ERROR("Invalid lookahead_jobs %zu, at most %zu are supported.\n", window, BackfillPacker::MAX_WINDOW);
+    return false;
+  }
+  if (time_budget <= 0) {
+    LOG_ERROR("Invalid lookahead_time_us %lld, it must be positive.\n", (long long) time_budget);
+    return false;
+  }
+
+  packer.set_window(window);
+  packer.set_time_budget(std::chrono::microseconds(time_budget));
+  return true;
+}
+
+/**
+ * @brief Reads the switch_off key and the sleep pstate of the hosts from the awake_pstate,
+ *        sleep_pstate, p_off_est and switch_* keys.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_sleep_config(const nlohmann::json & config, bool & enabled, SleepConfig & sleep) {
+  if (!read_config_value(config, "switch_off", enabled) ||
+      !read_config_value(config, "awake_pstate", sleep.awake_pstate) ||
+      !read_config_value(config, "sleep_pstate", sleep.sleep_pstate) ||
+      !read_config_value(config, "p_off_est", sleep.off_power) ||
+      !read_config_value(config, "switch_off_time", sleep.switch_off_time) ||
+      !read_config_value(config, "switch_on_time", sleep.switch_on_time) ||
+      !read_config_value(config, "switch_off_energy", sleep.switch_off_energy) ||
+      !read_config_value(config, "switch_on_energy", sleep.switch_on_energy)) {
+    return false;
+  }
+  if (sleep.off_power < 0 || sleep.switch_off_time < 0 || sleep.switch_on_time < 0 ||
+      sleep.switch_off_energy < 0 || sleep.switch_on_energy < 0) {
+    LOG_ERROR("Invalid sleep pstate, its power and transitions must not be negative.\n");
+    return false;
+  }
+  if ((sleep.switch_off_energy > 0 && sleep.switch_off_time == 0) ||
+      (sleep.switch_on_energy > 0 && sleep.switch_on_time == 0)) {
+    LOG_ERROR("Invalid sleep pstate, a transition taking energy must have a duration.\n");
+    return false;
+  }
+  if (sleep.awake_pstate == sleep.sleep_pstate) {
+    LOG_ERROR("Invalid sleep_pstate %u, it must differ from awake_pstate.\n", sleep.sleep_pstate);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the snapshot_file, snapshot_time and restore_file keys.
+ * @param[out] time Time of the snapshot, NEVER if snapshot_file is not present.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_snapshot_config(const nlohmann::json & config, std::string & path, double & time,
+                                 std::string & restore_path) {
+  double snapshot_time = 0;
+  if (!read_config_value(config, "snapshot_file", path) ||
+      !read_config_value(config, "snapshot_time", snapshot_time) ||
+      !read_config_value(config, "restore_file", restore_path)) {
+    return false;
+  }
+  if (snapshot_time < 0) {
+    LOG_ERROR("Invalid snapshot_time %g, it must not be negative.\n", snapshot_time);
+    return false;
+  }
+  time = path.empty() ? EnergyLedger::NEVER : snapshot_time;
+  return true;
+}
+
+/**
+ * @brief Reads the walltime_correction key and sets up predictor from the walltime_quantile,
+ *        walltime_min_samples and walltime_decay keys.
+ * @return False if a key is present but invalid.
+ */
+inline bool read_walltime_correction_config(const nlohmann::json & config, bool & enabled,
+                                            WalltimePredictor & predictor) {
+  double quantile = 0.9;
+  uint32_t min_samples = 20;
+  double decay = 0.99;
+  if (!read_config_value(config, "walltime_correction", enabled) ||
+      !read_config_value(config, "walltime_quantile", quantile) ||
+      !read_config_value(config, "walltime_min_samples", min_samples) ||
+      !read_config_value(config, "walltime_decay", decay)) {
+    return false;
+  }
+  if (quantile <= 0 || quantile > 1) {
+    LOG_ERROR("Invalid walltime_quantile %g, it must be within (0, 1].\n", quantile);
+    return false;
+  }
+  if (decay <= 0 || decay > 1) {
+    LOG_ERROR("Invalid walltime_decay %g, it must be within (0, 1].\n", decay);
+    return false;
+  }
+
+  predictor.configure(quantile, min_samples, decay);
+  return true;
+}
+
+// A partition of the partitions key, see SchedEngine
+struct PartitionConfig {
+  std::string name;
+  HostAllocation hosts;                              // From the hosts key, empty with partition_property
+  nlohmann::json config = nlohmann::json::object(); // Keys overriding the ones of the platform
+};
+
+/**
+ * @brief Parses a list of host ids such as "0-63,128-191" or "0-63 128-191".
+ * @return False if it is not a list of sorted and disjoint ranges.
+ */
+inline bool parse_host_ranges(const std::string & text, HostAllocation & hosts) {
+  hosts.clear();
+  const char * c = text.c_str();
+  while (*c != '\0') {
+    if (*c == ',' || *c == ' ') {
+      ++c;
+      continue;
+    }
+    char * end;
+    unsigned long first = strtoul(c, &end, 10);
+    unsigned long last = first;
+    if (end == c) {
+      return false;
+    }
+    if (*end == '-') {
+      c = end + 1;
+      last = strtoul(c, &end, 10);
+      if (end == c) {
+        return false;
+      }
+    }
+    if (first > last || last >= UINT32_MAX ||
+        (!hosts.ranges.empty() && first <= hosts.ranges.back().last)) {
+      return false;
+    }
+    hosts.append(static_cast<uint32_t>(first), static_cast<uint32_t>(last));
+    c = end;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the partitions and partition_property keys.
+ * @param[out] partitions The partitions, left empty if the key is missing.
+ * @return False if a key is present but invalid: partitions must have distinct names, and disjoint
+ *         hosts unless partition_property is set.
+ */
+inline bool read_partitions_config(const nlohmann::json & config, std::vector<PartitionConfig> & partitions,
+                                   std::string & property) {
+  partitions.clear();
+  if (!read_config_value(config, "partition_property", property)) {
+    return false;
+  }
+  auto it = config.find("partitions");
+  if (it == config.end()) {
+    if (!property.empty()) {
+      LOG_ERROR("Invalid partition_property without partitions.\n");
+      return false;
+    }
+    return true;
+  }
+  if (!it->is_array() || it->empty()) {
+    LOG_ERROR("Invalid value for configuration key 'partitions': expected a list of partitions\n");
+    return false;
+  }
+
+  std::set<std::string> names;
+  for (const nlohmann::json & entry : *it) {
+    PartitionConfig partition;
+    std::string hosts;
+    if (!entry.is_object() ||
+        !read_config_value(entry, "name", partition.name) ||
+        !read_config_value(entry, "hosts", hosts) ||
+        !read_config_value(entry, "config", partition.config) ||
+        partition.name.empty() || !partition.config.is_object() || !names.insert(partition.name).second) {
+      LOG_ERROR("Invalid partition '%s': it needs a distinct name, and its config must be an object\n",
+                entry.dump().c_str());
+      return false;
+    }
+    if (property.empty() == hosts.empty() || !parse_host_ranges(hosts, partition.hosts)) {
+      LOG_ERROR("Invalid hosts of partition '%s': expected sorted ranges such as \"0-63,128\", "
+                "unless partition_property is set\n", partition.name.c_str());
+      return false;
+    }
+    partitions.push_back(std::move(partition));
+  }
+
+  // the ranges of all the partitions, sorted, must not overlap
+  std::vector<std::pair<HostRange, const std::string *>> ranges;
+  for (const PartitionConfig & partition : partitions) {
+    for (const HostRange & range : partition.hosts.ranges) {
+      ranges.push_back({range, &partition.name});
+    }
+  }
+  std::sort(ranges.begin(), ranges.end(), [](const auto & a, const auto & b) { return a.first.first < b.first.first; });
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i].first.first <= ranges[i - 1].first.last) {
+      LOG_ERROR("Invalid hosts of partition '%s': host %u is in partition '%s' too\n",
+                ranges[i].second->c_str(), ranges[i].first.first, ranges[i - 1].second->c_str());
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+// Logging of the decision components.
+//
+// Messages at a level above EDC_LOG_MAX_LEVEL are removed at compile time, arguments included,
+// so the decision hot path does not pay for them. The maximum level is set by the log_level
+// meson option:
+//   meson setup build -Dlog_level=warning
+//
+// Messages up to EDC_LOG_MAX_LEVEL are then filtered at runtime by the log_level key
+// of the initialization data (see edc_config.hpp), "info" by default.
+
+#define EDC_LOG_LEVEL_OFF 0
+#define EDC_LOG_LEVEL_ERROR 1
+#define EDC_LOG_LEVEL_WARNING 2
+#define EDC_LOG_LEVEL_INFO 3
+#define EDC_LOG_LEVEL_DEBUG 4
+
+#ifndef EDC_LOG_MAX_LEVEL
+#define EDC_LOG_MAX_LEVEL EDC_LOG_LEVEL_DEBUG
+#endif
+
+// The first condition is a constant: disabled levels compile to nothing
+#define EDC_LOG(level, ...) \
+  do { \
+    if ((level) <= EDC_LOG_MAX_LEVEL && (level) <= edc_log_level) { \
+      printf(__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define LOG_ERROR(...) EDC_LOG(EDC_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARNING(...) EDC_LOG(EDC_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_INFO(...) EDC_LOG(EDC_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) EDC_LOG(EDC_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Runtime level of the library, one per decision component
+inline int edc_log_level = EDC_LOG_LEVEL_INFO;
+
+/**
+ * @brief Sets the runtime log level from its name (off, error, warning, info or debug).
+ * @return False if the name is unknown, the level is then unchanged.
+ */
+inline bool set_edc_log_level(const char * name) {
+  static const char * const names[] = {"off", "error", "warning", "info", "debug"};
+  for (int level = EDC_LOG_LEVEL_OFF; level <= EDC_LOG_LEVEL_DEBUG; ++level) {
+    if (strcmp(name, names[level]) == 0) {
+      edc_log_level = level;
+      return true;
+    }
+  }
+  LOG_ERROR("Unknown log level '%s', expected off, error, warning, info or debug\n", name);
+  return false;
+}
+
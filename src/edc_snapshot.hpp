@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include <nlohmann/json.hpp>
+
+#include "host_index.hpp"
+
+// A snapshot is the state of a decision component at the end of a call, written as a single JSON
+// object by SchedEngine::save_snapshot(), so that what-if runs resume from it instead of
+// simulating the same history again. Jobs are referred to by their Batsim id.
+//   format       version of the format, SNAPSHOT_FORMAT
+//   time         simulated time of the snapshot (s)
+//   platform     {"nb_hosts", "host_powers", "power_sums"}: [computing, idle] per host (W), only
+//                present when the powers were read from the platform, and the sums of the power
+//                estimate, see ResourceIndex::power_sums()
+//   energy       {"available", "consumed", "reservations"}: energy account (J), and the energy
+//                booked by the policy as {"job", "start", "energy"} objects
+//   pending      queued jobs in FCFS order: {"id", "nb_hosts", "walltime", "submission_time"}, the
+//                requested walltime, and "estimated_walltime" if it was corrected
+//   running      running jobs: the same keys, with "start_time", "expected_end_time",
+//                "estimated_energy" and "hosts"
+//   asleep       hosts asleep
+//   transitions  hosts switching pstate: {"end", "on", "hosts"}
+//   wakeups      instants of the wakeups requested and not received yet, see "nb_wakeups"
+//   pass         {"due_time", "energy_threshold", "rate", "in_window"}: what the next pass depends on
+//   metrics      metrics accumulated so far, see OnlineMetrics::save()
+//   walltime_predictor  samples of the walltime correction, if enabled, see WalltimePredictor::save()
+//   policy       {"name", "state"}: state of the policy, see Policy::save_state()
+// Hosts are lists of [first, last] ranges, NEVER times and energies are null.
+
+const int SNAPSHOT_FORMAT = 1;
+
+// JSON has no infinity: NEVER times and energies are written as null
+inline nlohmann::json double_to_json(double value) {
+  return std::isinf(value) ? nlohmann::json(nullptr) : nlohmann::json(value);
+}
+inline double double_from_json(const nlohmann::json & value) {
+  return value.is_null() ? std::numeric_limits<double>::infinity() : value.get<double>();
+}
+
+inline nlohmann::json hosts_to_json(const HostAllocation & allocation) {
+  nlohmann::json ranges = nlohmann::json::array();
+  for (const HostRange & range : allocation.ranges) {
+    ranges.push_back({range.first, range.last});
+  }
+  return ranges;
+}
+// Returns false if the ranges are not sorted and disjoint, throws nlohmann::json::exception if
+// they are not ranges
+inline bool hosts_from_json(const nlohmann::json & ranges, HostAllocation & allocation) {
+  allocation.clear();
+  for (const nlohmann::json & range : ranges) {
+    uint32_t first = range.at(0).get<uint32_t>();
+    uint32_t last = range.at(1).get<uint32_t>();
+    if (first > last || (!allocation.ranges.empty() && first <= allocation.ranges.back().last)) {
+      return false;
+    }
+    allocation.append(first, last);
+  }
+  return true;
+}
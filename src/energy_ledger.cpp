@@ -0,0 +1,363 @@
+#include "energy_ledger.hpp"
+
+#include <algorithm>
+
+void EnergyLedger::reset(double now) {
+  _available = 0;
+  _consumed = 0;
+  _last_update = now;
+  _power = 0;
+  _period = NO_PERIOD;
+  clear_reservations();
+}
+
+void EnergyLedger::restore(double now, double available, double consumed) {
+  _available = available;
+  _consumed = consumed;
+  _last_update = now;
+
+  // the period entered last by now, its carry-over still applies when the next one starts
+  auto it = std::upper_bound(_periods.begin(), _periods.end(), now,
+                             [](double t, const Period & period) { return t < period.start; });
+  _period = (it == _periods.begin()) ? NO_PERIOD : static_cast<size_t>(it - _periods.begin()) - 1;
+}
+
+void EnergyLedger::set_periods(std::vector<Period> periods) {
+  _periods = std::move(periods);
+  _period = NO_PERIOD;
+}
+
+void EnergyLedger::set_carry_over(CarryOver carry_over, double fraction) {
+  _carry_over = carry_over;
+  _carry_over_fraction = fraction;
+}
+
+size_t EnergyLedger::period_from(double time) const {
+  // the last period starting at or before time, if time is still within it
+  auto it = std::upper_bound(_periods.begin(), _periods.end(), time,
+                             [](double t, const Period & period) { return t < period.start; });
+  if (it != _periods.begin() && time < std::prev(it)->end) {
+    --it;
+  }
+  return (it == _periods.end()) ? NO_PERIOD : static_cast<size_t>(it - _periods.begin());
+}
+
+size_t EnergyLedger::period_of(double time) const {
+  size_t period = period_from(time);
+  return (period != NO_PERIOD && _periods[period].start <= time) ? period : NO_PERIOD;
+}
+
+double EnergyLedger::rate() const {
+  size_t period = period_of(_last_update);
+  return (period == NO_PERIOD) ? 0.0 : _periods[period].rate;
+}
+
+void EnergyLedger::carry_over() {
+  if (_available <= 0) {
+    return;
+  }
+  switch (_carry_over) {
+    case CarryOver::ALL: break;
+    case CarryOver::NONE: _available = 0; break;
+    case CarryOver::FRACTION: _available *= _carry_over_fraction; break;
+  }
+}
+
+void EnergyLedger::advance(double now, double power) {
+  _power = power;
+
+  // account [last update, now] period by period, usually within a single period
+  double time = _last_update;
+  size_t period = period_from(time);
+  while (period != NO_PERIOD && _periods[period].start <= now) {
+    const Period & p = _periods[period];
+    if (period != _period) {
+      if (_period != NO_PERIOD) {
+        carry_over();
+      }
+      _period = period;
+    }
+
+    double from = std::max(time, p.start);
+    double to = std::min(now, p.end);
+    double elapsed = std::max(0.0, to - from);
+    double consumed = power * elapsed;
+    _consumed += consumed;
+    _available += p.rate * elapsed;
+    if (_debit_consumption) {
+      _available = std::max(0.0, _available - consumed);
+    }
+
+    time = to;
+    if (to < p.end) {
+      break; // now is within the period
+    }
+    period = (period + 1 < _periods.size()) ? period + 1 : NO_PERIOD;
+  }
+  _last_update = std::max(_last_update, now);
+}
+
+double EnergyLedger::projected_rate() const {
+  double release = rate();
+  return std::max(0.0, _debit_consumption ? release - _power : release);
+}
+
+// Reservations are ordered by start time, then by key
+bool EnergyLedger::before(uint32_t a, uint32_t b) const {
+  const Node & na = _nodes[a];
+  const Node & nb = _nodes[b];
+  return (na.start < nb.start) || (na.start == nb.start && a < b);
+}
+
+void EnergyLedger::pull(uint32_t node) {
+  Node & n = _nodes[node];
+  double left_sum = (n.left == NIL) ? 0.0 : _nodes[n.left].sum;
+  double booked = left_sum + n.energy; // energy booked up to this node, within the subtree
+  n.sum = booked + ((n.right == NIL) ? 0.0 : _nodes[n.right].sum);
+
+  // upper hull of the left points, this one and the right ones, already sorted by start.
+  // Of the points with the same start, only the highest counts.
+  std::vector<HullPoint> & hull = n.hull;
+  hull.clear();
+  auto add = [&hull](double start, double point_booked) {
+    if (!hull.empty() && hull.back().start == start) {
+      if (hull.back().booked >= point_booked) {
+        return;
+      }
+      hull.pop_back();
+    }
+    while (hull.size() >= 2) {
+      const HullPoint & a = hull[hull.size() - 2];
+      const HullPoint & b = hull.back();
+      // b is dropped if it is not above the segment from a to the new point
+      if ((b.start - a.start) * (point_booked - a.booked) - (b.booked - a.booked) * (start - a.start) < 0) {
+        break;
+      }
+      hull.pop_back();
+    }
+    hull.push_back({start, point_booked});
+  };
+  if (n.left != NIL) {
+    for (const HullPoint & point : _nodes[n.left].hull) {
+      add(point.start, point.booked);
+    }
+  }
+  add(n.start, booked);
+  if (n.right != NIL) {
+    for (const HullPoint & point : _nodes[n.right].hull) {
+      add(point.start, booked + point.booked);
+    }
+  }
+}
+
+double EnergyLedger::min_level(uint32_t node, double rate) const {
+  // rate * start - booked is the lowest at the vertex where the slopes of the hull, decreasing,
+  // go below rate
+  const std::vector<HullPoint> & hull = _nodes[node].hull;
+  size_t low = 0, high = hull.size() - 1;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (hull[mid + 1].booked - hull[mid].booked > rate * (hull[mid + 1].start - hull[mid].start)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return rate * hull[low].start - hull[low].booked;
+}
+
+void EnergyLedger::split(uint32_t tree, uint32_t key, uint32_t & lower, uint32_t & upper) {
+  if (tree == NIL) {
+    lower = upper = NIL;
+  } else if (before(tree, key)) {
+    split(_nodes[tree].right, key, _nodes[tree].right, upper);
+    lower = tree;
+    pull(tree);
+  } else {
+    split(_nodes[tree].left, key, lower, _nodes[tree].left);
+    upper = tree;
+    pull(tree);
+  }
+}
+
+uint32_t EnergyLedger::merge(uint32_t lower, uint32_t upper) {
+  if (lower == NIL) return upper;
+  if (upper == NIL) return lower;
+  if (_nodes[lower].priority > _nodes[upper].priority) {
+    _nodes[lower].right = merge(_nodes[lower].right, upper);
+    pull(lower);
+    return lower;
+  }
+  _nodes[upper].left = merge(lower, _nodes[upper].left);
+  pull(upper);
+  return upper;
+}
+
+void EnergyLedger::reserve(uint32_t key, double start, double energy) {
+  cancel(key);
+  if (key >= _nodes.size()) {
+    _nodes.resize(key + 1);
+  }
+
+  Node & node = _nodes[key];
+  node.start = start;
+  node.energy = energy;
+  node.reserved = true;
+  // a fixed pseudo-random priority per key keeps the treap balanced and the runs reproducible
+  uint32_t hash = key * 2654435761u;
+  node.priority = hash ^ (hash >> 16);
+  node.left = node.right = NIL;
+  pull(key);
+
+  uint32_t lower, upper;
+  split(_root, key, lower, upper);
+  _root = merge(merge(lower, key), upper);
+  ++_nb_reservations;
+}
+
+uint32_t EnergyLedger::erase(uint32_t tree, uint32_t key) {
+  Node & n = _nodes[tree];
+  if (tree == key) {
+    return merge(n.left, n.right);
+  }
+  if (before(key, tree)) {
+    n.left = erase(n.left, key);
+  } else {
+    n.right = erase(n.right, key);
+  }
+  pull(tree);
+  return tree;
+}
+
+void EnergyLedger::cancel(uint32_t key) {
+  if (!is_reserved(key)) {
+    return;
+  }
+  _root = erase(_root, key);
+  _nodes[key].reserved = false;
+  --_nb_reservations;
+}
+
+void EnergyLedger::clear_reservations() {
+  _nodes.clear();
+  _root = NIL;
+  _nb_reservations = 0;
+}
+
+std::vector<EnergyLedger::Reservation> EnergyLedger::reservations() const {
+  std::vector<Reservation> reservations;
+  reservations.reserve(_nb_reservations);
+  for (uint32_t key = 0; key < _nodes.size(); ++key) {
+    if (_nodes[key].reserved) {
+      reservations.push_back({key, _nodes[key].start, _nodes[key].energy});
+    }
+  }
+  return reservations;
+}
+
+double EnergyLedger::booked_until(double time) const {
+  double booked = 0;
+  uint32_t node = _root;
+  while (node != NIL) {
+    const Node & n = _nodes[node];
+    if (n.start <= time) {
+      booked += n.energy + ((n.left == NIL) ? 0.0 : _nodes[n.left].sum);
+      node = n.right;
+    } else {
+      node = n.left;
+    }
+  }
+  return booked;
+}
+
+double EnergyLedger::projected(double time) const {
+  time = std::max(time, _last_update);
+  return _available + projected_rate() * (time - _last_update) - booked_until(time);
+}
+
+double EnergyLedger::earliest_start(double energy, double not_before) const {
+  double now = _last_update;
+  double rate = projected_rate();
+
+  // The projected energy right after the start of reservation i is
+  //   available + rate * (start_i - now) - booked_i
+  // where rate * start_i - booked_i is the level of i. Once energy is taken, each later drop
+  // must stay non-negative: find the last reservation whose level is too low.
+  double threshold = energy - _available + rate * now;
+  uint32_t node = _root;
+  bool found = false;
+  double start = now;
+  double booked = 0; // energy booked before the subtree of node
+  while (node != NIL) {
+    const Node & n = _nodes[node];
+    double left_sum = (n.left == NIL) ? 0.0 : _nodes[n.left].sum;
+    double until = booked + left_sum + n.energy;
+    if (n.right != NIL && min_level(n.right, rate) - until < threshold) {
+      booked = until;
+      node = n.right;
+    } else if (rate * n.start - until < threshold) {
+      found = true;
+      start = n.start;
+      booked = until;
+      break;
+    } else if (n.left != NIL && min_level(n.left, rate) - booked < threshold) {
+      node = n.left;
+    } else {
+      break;
+    }
+  }
+
+  // Energy taken after that drop only has to be there: it grows from there at the projected
+  // rate, and stays above energy at the later drops. Passed reservations are due now.
+  double level;
+  if (!found || start <= now) {
+    start = now;
+    level = _available - booked_until(now);
+  } else {
+    level = _available + rate * (start - now) - booked;
+  }
+
+  if (level < energy) {
+    if (rate <= 0) {
+      return NEVER;
+    }
+    start += (energy - level) / rate;
+  }
+  return std::max(start, not_before);
+}
+
+double EnergyLedger::min_level_after(double time, double rate) const {
+  double lowest = NEVER;
+  double booked = 0; // energy booked before the subtree of node
+  uint32_t node = _root;
+  while (node != NIL) {
+    const Node & n = _nodes[node];
+    double left_sum = (n.left == NIL) ? 0.0 : _nodes[n.left].sum;
+    double until = booked + left_sum + n.energy;
+    if (n.start > time) {
+      // n and its right subtree start after time
+      lowest = std::min(lowest, rate * n.start - until);
+      if (n.right != NIL) {
+        lowest = std::min(lowest, min_level(n.right, rate) - until);
+      }
+      node = n.left;
+    } else {
+      booked = until;
+      node = n.right;
+    }
+  }
+  return lowest;
+}
+
+double EnergyLedger::headroom() const {
+  double now = _last_update;
+  double rate = projected_rate();
+
+  // The energy due now must be there, and each later drop must stay non-negative
+  double headroom = _available - booked_until(now);
+  double lowest = min_level_after(now, rate);
+  if (lowest < NEVER) {
+    headroom = std::min(headroom, _available - rate * now + lowest);
+  }
+  return headroom;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * @brief Energy budget account of a decision component (J).
+ * @details The budget is a calendar of periods, each making energy available at its own
+ *          constant rate. The energy consumed by the platform is integrated from its estimated
+ *          power, which is constant between two advance() calls. Both only happen within the
+ *          periods. Depending on the policy, the consumption is also debited from the available
+ *          energy, and launched jobs debit their estimate. At the start of a period, the energy
+ *          left from the previous one carries over according to the carry-over policy.
+ *
+ *          Reservations book energy to be debited at a future start time. With them, the
+ *          projected available energy is a piecewise-linear timeline: it grows at the projected
+ *          rate and drops at each reservation start. Reservations are kept in a treap ordered by
+ *          start time. The level of a reservation, rate * start - energy booked up to start, depends
+ *          on the projected rate, which changes with the platform power when the consumption is
+ *          debited: each node rather holds the upper hull of the (start, booked) points of its
+ *          subtree, on which the lowest level for any rate is found by binary search. The earliest
+ *          start that keeps the timeline above a level is found in O(log^2 n) whatever the rate,
+ *          reserve() and cancel() rebuild the hulls along their path, in O(n) at worst.
+ */
+class EnergyLedger {
+public:
+  static constexpr double NEVER = std::numeric_limits<double>::infinity();
+
+  // A budget period [start, end), during which energy is made available at rate (W)
+  struct Period {
+    double start = 0;
+    double end = NEVER;
+    double rate = 0;
+  };
+
+  // What becomes of the energy left unused at the end of a period. A debt always carries over.
+  enum class CarryOver {
+    ALL,      // kept, the default
+    NONE,     // lost
+    FRACTION  // only the carry-over fraction is kept
+  };
+
+  // Empties the account at time now, keeping the periods, carry-over and debit settings
+  void reset(double now);
+  // Sets the account left at now by a snapshot (see SchedEngine::save_snapshot()), once the
+  // periods are set. Its reservations are made again with reserve().
+  void restore(double now, double available, double consumed);
+
+  // A single period covering the whole simulation, making energy available at rate (W)
+  void set_rate(double rate) { set_periods({Period{0, NEVER, rate}}); }
+  // Replaces the budget calendar by periods, sorted by start time and disjoint
+  void set_periods(std::vector<Period> periods);
+  const std::vector<Period> & periods() const { return _periods; }
+  void set_carry_over(CarryOver carry_over, double fraction = 1.0);
+
+  // Energy made available per second by the period of the last update (W), 0 between periods
+  double rate() const;
+  // Whether time is within a budget period, in O(log n)
+  bool in_window(double time) const { return period_of(time) != NO_PERIOD; }
+  // Whether the energy consumed by the platform is taken from the available energy,
+  // which then never goes below zero
+  void set_debit_consumption(bool debit) { _debit_consumption = debit; }
+
+  // Accounts the time elapsed since the last call, during which the platform drew power (W)
+  void advance(double now, double power);
+  // Power the platform draws from now on (W), e.g. once jobs are launched or completed.
+  // Projections assume it stays the same.
+  void set_power(double power) { _power = power; }
+  double power() const { return _power; }
+
+  // Takes energy from the available energy, e.g. the estimate of a launched job
+  void debit(double energy) { _available -= energy; }
+
+  double available() const { return _available; }
+  double consumed() const { return _consumed; }
+  double last_update() const { return _last_update; }
+
+  // Books energy to be debited at start (finite), e.g. by the job of handle key.
+  // Replaces the previous reservation of key. Keys are small integers, like job handles.
+  void reserve(uint32_t key, double start, double energy);
+  // Removes the reservation of key, if any
+  void cancel(uint32_t key);
+  void clear_reservations();
+  // A booked reservation, see reservations()
+  struct Reservation {
+    uint32_t key;
+    double start;
+    double energy;
+  };
+  // The reservations by key, e.g. for snapshots
+  std::vector<Reservation> reservations() const;
+  bool is_reserved(uint32_t key) const { return key < _nodes.size() && _nodes[key].reserved; }
+  size_t nb_reservations() const { return _nb_reservations; }
+  // Total energy booked by the reservations
+  double reserved() const { return (_root == NIL) ? 0.0 : _nodes[_root].sum; }
+
+  // Rate at which the available energy is projected to grow (W): the release rate of the
+  // current period, minus the platform power if the consumption is debited. Never negative.
+  // Projections assume it stays the same, across later periods too.
+  double projected_rate() const;
+  // Projected available energy at time, once the reservations due by then are debited.
+  // Reservations whose start has passed are due now.
+  double projected(double time) const;
+  /**
+   * @brief Earliest time, not before not_before nor now, at which energy can be taken without
+   *        the projected available energy going negative afterwards, i.e. without delaying any
+   *        reservation.
+   * @return NEVER if the projected energy does not grow enough.
+   */
+  double earliest_start(double energy, double not_before = 0) const;
+  // Energy that can be taken now without delaying any reservation: earliest_start(energy) is now
+  // if and only if energy <= headroom(), up to rounding. Negative if the reservations are short.
+  double headroom() const;
+
+private:
+  static const uint32_t NIL = UINT32_MAX;
+  static const size_t NO_PERIOD = SIZE_MAX;
+
+  // Index of the period containing time, or NO_PERIOD
+  size_t period_of(double time) const;
+  // Index of the period containing time, or of the first one after it, or NO_PERIOD
+  size_t period_from(double time) const;
+  // Applies the carry-over policy to the energy left when entering a new period
+  void carry_over();
+
+  // Vertex of the hull of a subtree: start of a reservation, and energy booked up to it within the subtree
+  struct HullPoint {
+    double start;
+    double booked;
+  };
+
+  // Reservation of a key, a treap node when reserved
+  struct Node {
+    double start = 0;
+    double energy = 0;
+    bool reserved = false;
+    uint32_t priority = 0;
+    uint32_t left = NIL;
+    uint32_t right = NIL;
+    // Over the subtree: total energy, and upper hull of its points, by start
+    double sum = 0;
+    std::vector<HullPoint> hull;
+  };
+
+  // Whether the reservation of a is ordered before the one of b
+  bool before(uint32_t a, uint32_t b) const;
+  // Recomputes the sum and hull of node from its children
+  void pull(uint32_t node);
+  // Lowest level rate * start - booked of the subtree of node, booked counted from the subtree
+  double min_level(uint32_t node, double rate) const;
+  // Splits tree into the nodes ordered before key, and the others
+  void split(uint32_t tree, uint32_t key, uint32_t & lower, uint32_t & upper);
+  uint32_t merge(uint32_t lower, uint32_t upper);
+  // Removes key from tree, returns the new root
+  uint32_t erase(uint32_t tree, uint32_t key);
+  // Energy booked by the reservations starting at or before time
+  double booked_until(double time) const;
+  // Lowest level among the reservations starting after time at rate, NEVER if there is none
+  double min_level_after(double time, double rate) const;
+
+private:
+  std::vector<Period> _periods = {Period{}};
+  CarryOver _carry_over = CarryOver::ALL;
+  double _carry_over_fraction = 1.0;
+  bool _debit_consumption = false;
+  size_t _period = NO_PERIOD; // Period of the last accounted energy
+
+  double _available = 0;
+  double _consumed = 0;
+  double _last_update = 0;
+  double _power = 0; // Current power of the platform
+
+  std::vector<Node> _nodes; // by key
+  uint32_t _root = NIL;
+  size_t _nb_reservations = 0;
+};
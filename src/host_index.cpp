@@ -0,0 +1,291 @@
+#include "host_index.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+static const uint32_t WORD_BITS = 64;
+
+// Mask of the bits [lo, hi] of a word, with 0 <= lo <= hi < 64
+static inline uint64_t bit_mask(uint32_t lo, uint32_t hi) {
+  uint64_t upto_hi = (hi == WORD_BITS - 1) ? ~uint64_t(0) : ((uint64_t(1) << (hi + 1)) - 1);
+  return upto_hi & (~uint64_t(0) << lo);
+}
+
+void HostAllocation::clear() {
+  ranges.clear();
+  nb_hosts = 0;
+}
+
+void HostAllocation::append(uint32_t first, uint32_t last) {
+  if (!ranges.empty() && ranges.back().last + 1 == first) {
+    ranges.back().last = last;
+  } else {
+    ranges.push_back({first, last});
+  }
+  nb_hosts += last - first + 1;
+}
+
+void HostAllocation::write_hyphen(std::string & buffer) const {
+  buffer.clear();
+  char range[2 * 10 + 2]; // ",first-last" with 32-bit ids
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    char * end = range;
+    if (i > 0) *end++ = ',';
+    end = std::to_chars(end, range + sizeof(range), ranges[i].first).ptr;
+    if (ranges[i].last != ranges[i].first) {
+      *end++ = '-';
+      end = std::to_chars(end, range + sizeof(range), ranges[i].last).ptr;
+    }
+    buffer.append(range, end);
+  }
+}
+
+std::string HostAllocation::to_string_hyphen() const {
+  std::string str;
+  write_hyphen(str);
+  return str;
+}
+
+void HostIndex::reset(uint32_t nb_hosts) {
+  _nb_hosts = nb_hosts;
+  _nb_free = nb_hosts;
+  _free_words.assign((nb_hosts + WORD_BITS - 1) / WORD_BITS, ~uint64_t(0));
+
+  // hosts beyond nb_hosts in the last word do not exist and are never free
+  if (nb_hosts % WORD_BITS != 0) {
+    _free_words.back() = bit_mask(0, nb_hosts % WORD_BITS - 1);
+  }
+
+  _nb_leaves = 1;
+  while (_nb_leaves < _free_words.size()) {
+    _nb_leaves *= 2;
+  }
+  _tree.assign(2 * _nb_leaves, word_runs(0));
+  for (uint32_t w = 0; w < _free_words.size(); ++w) {
+    _tree[_nb_leaves + w] = word_runs(_free_words[w]);
+  }
+  for (uint32_t node = _nb_leaves - 1; node >= 1; --node) {
+    _tree[node] = merge(_tree[2 * node], _tree[2 * node + 1]);
+  }
+}
+
+bool HostIndex::is_free(uint32_t host) const {
+  return host < _nb_hosts && ((_free_words[host / WORD_BITS] >> (host % WORD_BITS)) & 1);
+}
+
+bool HostIndex::take(uint32_t nb, HostAllocation & allocation) {
+  if (nb > _nb_free) {
+    return false;
+  }
+
+  uint32_t remaining = nb;
+  size_t w = 0;
+  for (; w < _free_words.size() && remaining > 0; ++w) {
+    uint64_t word = _free_words[w];
+    while (word != 0 && remaining > 0) {
+      // extract the lowest run of set bits of the word
+      uint32_t lo = __builtin_ctzll(word);
+      uint64_t above = ~(word >> lo);
+      uint32_t run = (above == 0) ? WORD_BITS - lo : __builtin_ctzll(above);
+      run = std::min(run, remaining);
+
+      uint64_t mask = bit_mask(lo, lo + run - 1);
+      word &= ~mask;
+      _free_words[w] &= ~mask;
+
+      uint32_t first = static_cast<uint32_t>(w) * WORD_BITS + lo;
+      allocation.append(first, first + run - 1);
+      remaining -= run;
+    }
+  }
+
+  if (w > 0) {
+    update_tree(0, static_cast<uint32_t>(w) - 1);
+  }
+  _nb_free -= nb;
+  return true;
+}
+
+bool HostIndex::take(const HostAllocation & allocation) {
+  // the ranges of an allocation are disjoint: they are all free or nothing is taken
+  for (const HostRange & range : allocation.ranges) {
+    if (range.first > range.last || range.last >= _nb_hosts || !range_free(range.first, range.last)) {
+      return false;
+    }
+  }
+  for (const HostRange & range : allocation.ranges) {
+    mark_range(range.first, range.last, false);
+  }
+  return true;
+}
+
+bool HostIndex::find(uint32_t nb, HostAllocation & allocation) const {
+  if (nb > _nb_free) {
+    return false;
+  }
+
+  uint32_t remaining = nb;
+  for (size_t w = 0; w < _free_words.size() && remaining > 0; ++w) {
+    uint64_t word = _free_words[w];
+    while (word != 0 && remaining > 0) {
+      uint32_t lo = __builtin_ctzll(word);
+      uint64_t above = ~(word >> lo);
+      uint32_t run = (above == 0) ? WORD_BITS - lo : __builtin_ctzll(above);
+      run = std::min(run, remaining);
+      word &= ~bit_mask(lo, lo + run - 1);
+
+      uint32_t first = static_cast<uint32_t>(w) * WORD_BITS + lo;
+      allocation.append(first, first + run - 1);
+      remaining -= run;
+    }
+  }
+  return true;
+}
+
+bool HostIndex::take_contiguous(uint32_t nb, HostAllocation & allocation, bool fragmented_fallback) {
+  if (nb == 0 || nb > _nb_free) {
+    return nb == 0;
+  }
+
+  uint32_t first = find_contiguous(nb);
+  if (first == _nb_hosts) {
+    return fragmented_fallback && take(nb, allocation);
+  }
+
+  mark_range(first, first + nb - 1, false);
+  allocation.append(first, first + nb - 1);
+  return true;
+}
+
+uint32_t HostIndex::find_contiguous(uint32_t nb) const {
+  if (nb == 0 || _tree.empty() || _tree[1].max < nb) {
+    return _nb_hosts;
+  }
+
+  // descend towards the leftmost node that contains a long enough run
+  uint32_t node = 1;
+  uint32_t offset = 0; // first host of node
+  while (node < _nb_leaves) {
+    const Runs & left = _tree[2 * node];
+    const Runs & right = _tree[2 * node + 1];
+    if (left.max >= nb) {
+      node = 2 * node;
+    } else if (left.suffix + right.prefix >= nb) {
+      // the run starts at the end of the left child and continues on the right one
+      return offset + left.length - left.suffix;
+    } else {
+      offset += left.length;
+      node = 2 * node + 1;
+    }
+  }
+
+  // the run is inside a single word
+  uint64_t word = _free_words[node - _nb_leaves];
+  while (word != 0) {
+    uint32_t lo = __builtin_ctzll(word);
+    uint64_t above = ~(word >> lo);
+    uint32_t run = (above == 0) ? WORD_BITS - lo : __builtin_ctzll(above);
+    if (run >= nb) {
+      return offset + lo;
+    }
+    word &= ~bit_mask(lo, lo + run - 1);
+  }
+  return _nb_hosts; // unreachable while the tree is consistent
+}
+
+uint32_t HostIndex::max_contiguous() const {
+  return _tree.empty() ? 0 : _tree[1].max;
+}
+
+void HostIndex::release(const HostAllocation & allocation) {
+  for (const HostRange & range : allocation.ranges) {
+    release(range.first, range.last);
+  }
+}
+
+void HostIndex::release(uint32_t first, uint32_t last) {
+  mark_range(first, last, true);
+}
+
+bool HostIndex::range_free(uint32_t first, uint32_t last) const {
+  uint32_t first_word = first / WORD_BITS;
+  uint32_t last_word = last / WORD_BITS;
+  for (uint32_t w = first_word; w <= last_word; ++w) {
+    uint32_t lo = (w == first_word) ? first % WORD_BITS : 0;
+    uint32_t hi = (w == last_word) ? last % WORD_BITS : WORD_BITS - 1;
+    uint64_t mask = bit_mask(lo, hi);
+    if ((_free_words[w] & mask) != mask) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HostIndex::mark_range(uint32_t first, uint32_t last, bool free) {
+  uint32_t first_word = first / WORD_BITS;
+  uint32_t last_word = last / WORD_BITS;
+
+  for (uint32_t w = first_word; w <= last_word; ++w) {
+    uint32_t lo = (w == first_word) ? first % WORD_BITS : 0;
+    uint32_t hi = (w == last_word) ? last % WORD_BITS : WORD_BITS - 1;
+    uint64_t mask = bit_mask(lo, hi);
+
+    // only count the hosts whose state actually changes
+    uint32_t changed = __builtin_popcountll(free ? (mask & ~_free_words[w]) : (mask & _free_words[w]));
+    if (free) {
+      _free_words[w] |= mask;
+      _nb_free += changed;
+    } else {
+      _free_words[w] &= ~mask;
+      _nb_free -= changed;
+    }
+  }
+
+  update_tree(first_word, last_word);
+}
+
+void HostIndex::update_tree(uint32_t first_word, uint32_t last_word) {
+  uint32_t lo = _nb_leaves + first_word;
+  uint32_t hi = _nb_leaves + last_word;
+  for (uint32_t leaf = lo; leaf <= hi; ++leaf) {
+    _tree[leaf] = word_runs(_free_words[leaf - _nb_leaves]);
+  }
+
+  // each level only recomputes the parents of the nodes changed below
+  while (lo > 1) {
+    lo /= 2;
+    hi /= 2;
+    for (uint32_t node = lo; node <= hi; ++node) {
+      _tree[node] = merge(_tree[2 * node], _tree[2 * node + 1]);
+    }
+  }
+}
+
+HostIndex::Runs HostIndex::word_runs(uint64_t word) {
+  if (word == ~uint64_t(0)) {
+    return {WORD_BITS, WORD_BITS, WORD_BITS, WORD_BITS};
+  }
+
+  Runs runs;
+  runs.prefix = __builtin_ctzll(~word);
+  runs.suffix = __builtin_clzll(~word);
+  runs.max = 0;
+  runs.length = WORD_BITS;
+  while (word != 0) {
+    uint32_t lo = __builtin_ctzll(word);
+    uint64_t above = ~(word >> lo);
+    uint32_t run = (above == 0) ? WORD_BITS - lo : __builtin_ctzll(above);
+    runs.max = std::max(runs.max, run);
+    word &= ~bit_mask(lo, lo + run - 1);
+  }
+  return runs;
+}
+
+HostIndex::Runs HostIndex::merge(const Runs & left, const Runs & right) {
+  Runs runs;
+  runs.prefix = (left.prefix == left.length) ? left.length + right.prefix : left.prefix;
+  runs.suffix = (right.suffix == right.length) ? right.length + left.suffix : right.suffix;
+  runs.max = std::max({left.max, right.max, left.suffix + right.prefix});
+  runs.length = left.length + right.length;
+  return runs;
+}
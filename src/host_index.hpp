@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A closed range of host ids [first, last].
+struct HostRange {
+  uint32_t first;
+  uint32_t last;
+};
+
+// The hosts allocated to a job, as sorted and disjoint ranges.
+struct HostAllocation {
+  std::vector<HostRange> ranges;
+  uint32_t nb_hosts = 0;
+
+  void clear();
+  // Appends [first, last], which must be located after all current ranges
+  void append(uint32_t first, uint32_t last);
+  // Same format as IntervalSet::to_string_hyphen(), as expected by add_execute_job: "0-511,640".
+  // buffer is overwritten, so that a reused buffer keeps its capacity.
+  void write_hyphen(std::string & buffer) const;
+  std::string to_string_hyphen() const;
+};
+
+/**
+ * @brief Index of the free hosts of the platform, as a word-packed bitmap.
+ * @details Hosts are taken and released in bulk: each 64-bit word is handled at once,
+ *          so taking k hosts costs O(nb_hosts/64 + number of resulting ranges).
+ *          A segment tree over the words keeps the longest free run of every subtree,
+ *          which finds the first block of k contiguous free hosts in O(log(nb_hosts)).
+ */
+class HostIndex {
+public:
+  // Resizes the index to nb_hosts hosts, all of them free
+  void reset(uint32_t nb_hosts);
+
+  uint32_t nb_hosts() const { return _nb_hosts; }
+  uint32_t nb_free() const { return _nb_free; }
+  uint32_t nb_used() const { return _nb_hosts - _nb_free; }
+  bool is_free(uint32_t host) const;
+
+  // Takes the nb lowest free hosts and appends them to allocation.
+  // Returns false and takes nothing if fewer than nb hosts are free.
+  bool take(uint32_t nb, HostAllocation & allocation);
+  // Takes the hosts of allocation, e.g. the ones of a restored job.
+  // Returns false and takes nothing if one of them is not free.
+  bool take(const HostAllocation & allocation);
+
+  // Appends the nb lowest free hosts to allocation without taking them, the ones take() would take.
+  // Returns false and appends nothing if fewer than nb hosts are free.
+  bool find(uint32_t nb, HostAllocation & allocation) const;
+
+  // Takes the first block of nb contiguous free hosts (first fit) and appends it to allocation.
+  // If there is no such block, takes the nb lowest free hosts instead when fragmented_fallback is set.
+  // Returns false and takes nothing if the allocation is not possible.
+  bool take_contiguous(uint32_t nb, HostAllocation & allocation, bool fragmented_fallback = false);
+
+  // Returns the first host of the first block of nb contiguous free hosts, or nb_hosts() if there is none
+  uint32_t find_contiguous(uint32_t nb) const;
+  // Length of the longest block of contiguous free hosts
+  uint32_t max_contiguous() const;
+
+  // Marks all the hosts of allocation as free again
+  void release(const HostAllocation & allocation);
+  void release(uint32_t first, uint32_t last);
+
+private:
+  // Free runs of a node of the segment tree: at its beginning, at its end, anywhere
+  struct Runs {
+    uint32_t prefix;
+    uint32_t suffix;
+    uint32_t max;
+    uint32_t length;
+  };
+
+  bool range_free(uint32_t first, uint32_t last) const;
+  void mark_range(uint32_t first, uint32_t last, bool free);
+  // Recomputes the tree nodes over the words [first_word, last_word]
+  void update_tree(uint32_t first_word, uint32_t last_word);
+  static Runs word_runs(uint64_t word);
+  static Runs merge(const Runs & left, const Runs & right);
+
+private:
+  std::vector<uint64_t> _free_words; // bit i of word w is set iff host 64*w+i is free
+  std::vector<Runs> _tree;           // implicit binary tree, leaves at [_nb_leaves, 2*_nb_leaves)
+  uint32_t _nb_leaves = 0;
+  uint32_t _nb_hosts = 0;
+  uint32_t _nb_free = 0;
+};
@@ -0,0 +1,94 @@
+#include "host_power.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+void HostPowerTable::reset(uint32_t nb_hosts, double computing_power, double idle_power) {
+  _uniform = true;
+  _computing_power = computing_power;
+  _idle_power = idle_power;
+  _computing.assign(nb_hosts, computing_power);
+  _idle.assign(nb_hosts, idle_power);
+  _computing_sums.clear();
+  _idle_sums.clear();
+  _min_increases.clear();
+  _max_increases.clear();
+}
+
+void HostPowerTable::set(uint32_t host, double computing_power, double idle_power) {
+  _computing[host] = computing_power;
+  _idle[host] = idle_power;
+}
+
+void HostPowerTable::build() {
+  uint32_t nb = nb_hosts();
+  _uniform = std::all_of(_computing.begin(), _computing.end(), [&](double power) { return power == _computing_power; }) &&
+             std::all_of(_idle.begin(), _idle.end(), [&](double power) { return power == _idle_power; });
+  if (_uniform) {
+    return;
+  }
+
+  _computing_sums.assign(nb + 1, 0.0);
+  _idle_sums.assign(nb + 1, 0.0);
+  std::vector<double> increases(nb);
+  for (uint32_t host = 0; host < nb; ++host) {
+    _computing_sums[host + 1] = _computing_sums[host] + _computing[host];
+    _idle_sums[host + 1] = _idle_sums[host] + _idle[host];
+    increases[host] = _computing[host] - _idle[host];
+  }
+
+  std::sort(increases.begin(), increases.end());
+  _min_increases.assign(nb + 1, 0.0);
+  _max_increases.assign(nb + 1, 0.0);
+  for (uint32_t i = 0; i < nb; ++i) {
+    _min_increases[i + 1] = _min_increases[i] + increases[i];
+    _max_increases[i + 1] = _max_increases[i] + increases[nb - 1 - i];
+  }
+}
+
+double HostPowerTable::computing_power(const HostAllocation & allocation) const {
+  return _uniform ? allocation.nb_hosts * _computing_power : range_sum(_computing_sums, allocation);
+}
+
+double HostPowerTable::idle_power(const HostAllocation & allocation) const {
+  return _uniform ? allocation.nb_hosts * _idle_power : range_sum(_idle_sums, allocation);
+}
+
+bool parse_wattage_per_state(const std::string & value, uint32_t pstate, double & computing_power,
+                             double & idle_power) {
+  // skip the groups of the previous pstates
+  size_t begin = 0;
+  for (uint32_t state = 0; state < pstate; ++state) {
+    begin = value.find(',', begin);
+    if (begin == std::string::npos) {
+      return false;
+    }
+    ++begin;
+  }
+  size_t end = std::min(value.find(',', begin), value.size());
+
+  // idle first, full load last: "idle:full" or "idle:one_core:all_cores"
+  std::vector<double> powers;
+  const char * cursor = value.c_str() + begin;
+  const char * group_end = value.c_str() + end;
+  while (cursor < group_end) {
+    char * parsed = nullptr;
+    double power = std::strtod(cursor, &parsed);
+    if (parsed == cursor || parsed > group_end || power < 0) {
+      return false;
+    }
+    powers.push_back(power);
+    while (parsed < group_end && *parsed == ' ') ++parsed;
+    if (parsed < group_end && *parsed != ':') {
+      return false;
+    }
+    cursor = parsed + 1;
+  }
+  if (powers.size() < 2) {
+    return false;
+  }
+
+  idle_power = powers.front();
+  computing_power = powers.back();
+  return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "host_index.hpp"
+
+/**
+ * @brief Computing and idle power of each host of the platform, as flat arrays.
+ * @details The sums of the powers of the first hosts are precomputed, so the power of an allocation
+ *          costs O(number of ranges) whatever its size. So are the sums of the n largest and
+ *          smallest power increases, which bound the increase of any n hosts in O(1).
+ *
+ *          When all the hosts are identical the sums are products, computed exactly as
+ *          nb_hosts * power. The scans of the policies rather use one of the power models below
+ *          (see backfill_verdict.hpp).
+ */
+class HostPowerTable {
+public:
+  // nb_hosts hosts of the same powers (W)
+  void reset(uint32_t nb_hosts, double computing_power, double idle_power);
+  // Sets the powers of a host (W), the sums are updated by the next build()
+  void set(uint32_t host, double computing_power, double idle_power);
+  // Precomputes the sums, once the hosts are set
+  void build();
+
+  uint32_t nb_hosts() const { return static_cast<uint32_t>(_computing.size()); }
+  bool uniform() const { return _uniform; }
+  double computing_power(uint32_t host) const { return _computing[host]; }
+  double idle_power(uint32_t host) const { return _idle[host]; }
+  // Powers of the whole platform, all hosts computing or idle (W)
+  double total_computing_power() const { return _uniform ? nb_hosts() * _computing_power : _computing_sums.back(); }
+  double total_idle_power() const { return _uniform ? nb_hosts() * _idle_power : _idle_sums.back(); }
+  // Average computing power of nb_hosts hosts (W), when they are not known yet
+  double mean_computing_power(uint32_t nb_hosts) const {
+    return _uniform ? nb_hosts * _computing_power : nb_hosts * (total_computing_power() / this->nb_hosts());
+  }
+
+  // Computing and idle power of the hosts of allocation (W)
+  double computing_power(const HostAllocation & allocation) const;
+  double idle_power(const HostAllocation & allocation) const;
+  // Power added when the hosts of allocation start computing (W)
+  double increase(const HostAllocation & allocation) const {
+    return _uniform ? allocation.nb_hosts * (_computing_power - _idle_power)
+                    : computing_power(allocation) - idle_power(allocation);
+  }
+  // Bounds of the power added when any nb_hosts hosts start computing (W)
+  double min_increase(uint32_t nb_hosts) const {
+    return _uniform ? nb_hosts * (_computing_power - _idle_power) : _min_increases[nb_hosts];
+  }
+  double max_increase(uint32_t nb_hosts) const {
+    return _uniform ? nb_hosts * (_computing_power - _idle_power) : _max_increases[nb_hosts];
+  }
+
+private:
+  friend struct UniformPower;
+  friend struct HostTablePower;
+
+  // Power of the hosts of allocation, from the prefix sums of a power (see _computing_sums)
+  static double range_sum(const std::vector<double> & sums, const HostAllocation & allocation) {
+    double sum = 0;
+    for (const HostRange & range : allocation.ranges) {
+      sum += sums[range.last + 1] - sums[range.first];
+    }
+    return sum;
+  }
+
+  bool _uniform = true;
+  double _computing_power = 0; // Powers of every host when uniform
+  double _idle_power = 0;
+
+  std::vector<double> _computing;
+  std::vector<double> _idle;
+  // Without uniform powers: sums of the powers of the hosts [0, i), and of the i smallest and
+  // largest increases
+  std::vector<double> _computing_sums;
+  std::vector<double> _idle_sums;
+  std::vector<double> _min_increases;
+  std::vector<double> _max_increases;
+};
+
+// Power models of the hosts, the same results as HostPowerTable for uniform() tables or not.
+// PER_HOST tells whether the hosts taken change the power, see ResourceIndex::power_increase().
+struct UniformPower {
+  static constexpr bool PER_HOST = false;
+  double host_increase; // Of any host that starts computing (W)
+
+  explicit UniformPower(const HostPowerTable & powers)
+      : host_increase(powers._computing_power - powers._idle_power) {}
+  double increase(const HostAllocation & allocation) const { return allocation.nb_hosts * host_increase; }
+  double min_increase(uint32_t nb_hosts) const { return nb_hosts * host_increase; }
+  double max_increase(uint32_t nb_hosts) const { return nb_hosts * host_increase; }
+};
+
+struct HostTablePower {
+  static constexpr bool PER_HOST = true;
+  const HostPowerTable * powers;
+
+  explicit HostTablePower(const HostPowerTable & table) : powers(&table) {}
+  double increase(const HostAllocation & allocation) const {
+    return HostPowerTable::range_sum(powers->_computing_sums, allocation) -
+           HostPowerTable::range_sum(powers->_idle_sums, allocation);
+  }
+  double min_increase(uint32_t nb_hosts) const { return powers->_min_increases[nb_hosts]; }
+  double max_increase(uint32_t nb_hosts) const { return powers->_max_increases[nb_hosts]; }
+};
+
+/**
+ * @brief Reads the powers of a pstate from a SimGrid wattage_per_state host property, e.g.
+ *        "100:120:200, 9.75:9.75:9.75": one "idle:..:full" group per pstate, in W.
+ * @return False if the value is malformed or has no such pstate.
+ */
+bool parse_wattage_per_state(const std::string & value, uint32_t pstate, double & computing_power,
+                             double & idle_power);
@@ -0,0 +1,80 @@
+#include "job_store.hpp"
+
+JobStore::~JobStore() {
+  clear();
+}
+
+SchedJob * JobStore::create(std::string_view job_id) {
+  if (_handles.count(job_id) > 0) {
+    return nullptr;
+  }
+
+  JobHandle handle;
+  if (_free_handles.empty()) {
+    handle = static_cast<JobHandle>(_jobs.size());
+    _jobs.push_back(nullptr);
+    _running.push_back(false);
+  } else {
+    handle = _free_handles.back();
+    _free_handles.pop_back();
+  }
+
+  // pooled jobs do not move, neither does the view of their id
+  SchedJob * job = _pool.create();
+  job->handle = handle;
+  job->id.assign(job_id.data(), job_id.size());
+  _handles.emplace(job->id, handle);
+  _jobs[handle] = job;
+  return job;
+}
+
+void JobStore::destroy(SchedJob * job) {
+  JobHandle handle = job->handle;
+  _handles.erase(job->id);
+  _jobs[handle] = nullptr;
+  _free_handles.push_back(handle);
+  _pool.destroy(job);
+}
+
+JobHandle JobStore::handle_of(std::string_view job_id) const {
+  auto it = _handles.find(job_id);
+  return (it == _handles.end()) ? NO_JOB : it->second;
+}
+
+void JobStore::queue(SchedJob * job) {
+  _pending.push_back(job);
+}
+
+void JobStore::start(SchedJob * job) {
+  _pending.erase(job);
+  _running[job->handle] = true;
+  ++_nb_running;
+}
+
+SchedJob * JobStore::find_running(std::string_view job_id) const {
+  JobHandle handle = handle_of(job_id);
+  return (handle != NO_JOB && _running[handle]) ? _jobs[handle] : nullptr;
+}
+
+SchedJob * JobStore::finish(std::string_view job_id) {
+  SchedJob * job = find_running(job_id);
+  if (job != nullptr) {
+    _running[job->handle] = false;
+    --_nb_running;
+  }
+  return job;
+}
+
+void JobStore::clear() {
+  for (SchedJob * job : _jobs) {
+    if (job != nullptr) {
+      _pool.destroy(job);
+    }
+  }
+  _pending.clear();
+  _handles.clear();
+  _jobs.clear();
+  _running.clear();
+  _free_handles.clear();
+  _nb_running = 0;
+}
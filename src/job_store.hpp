@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "host_index.hpp"
+#include "object_pool.hpp"
+#include "wait_queue.hpp"
+
+// Dense integer handle of a known job, reused once the job is destroyed
+typedef uint32_t JobHandle;
+const JobHandle NO_JOB = UINT32_MAX;
+
+// A job as seen by the scheduling policies
+struct SchedJob {
+  JobHandle handle = NO_JOB;     // Key of the job in the internal indexes
+  std::string id;                // Batsim job id, the key of its handle in the JobStore
+  uint32_t nb_hosts = 0;
+  double walltime = 0;           // Walltime the job is scheduled with (s): the requested one, or its
+                                 // correction, see WalltimePredictor
+  double requested_walltime = 0; // Walltime after which the job is killed (s)
+  double submission_time = 0;
+  double start_time = 0;
+  double expected_end_time = 0;  // start_time + walltime once launched, until it outlives it
+  double estimated_energy = 0;   // Set by the policy at submission
+  HostAllocation allocation;     // Hosts of the job, once launched
+
+  const std::string & job_id() const { return id; }
+};
+
+/**
+ * @brief Owner of all the jobs known by a decision component.
+ * @details A job is created at submission, queued in the pending queue until it is launched,
+ *          then kept among the running jobs until it completes and is destroyed.
+ *          Jobs come from a slab allocator released in bulk with the store. Their Batsim id is
+ *          interned once at creation into a dense handle, which keys all the other lookups.
+ *          Ids are looked up as views, e.g. straight from the received message, without copies.
+ */
+class JobStore {
+public:
+  JobStore() = default;
+  JobStore(const JobStore &) = delete;
+  JobStore & operator=(const JobStore &) = delete;
+  ~JobStore();
+
+  // A new job of id job_id, owned by the store but neither pending nor running.
+  // Returns nullptr if a job of this id is already known.
+  SchedJob * create(std::string_view job_id);
+  // Destroys a job that is neither pending nor running, its handle may be reused
+  void destroy(SchedJob * job);
+
+  // Handle of the known job of id job_id, or NO_JOB
+  JobHandle handle_of(std::string_view job_id) const;
+  // Number of handles in use or free, every handle is below it
+  uint32_t handle_capacity() const { return static_cast<uint32_t>(_jobs.size()); }
+  // Known job of handle, or nullptr
+  SchedJob * get(JobHandle handle) const {
+    return (handle < _jobs.size()) ? _jobs[handle] : nullptr;
+  }
+
+  WaitQueue<SchedJob> & pending() { return _pending; }
+  const WaitQueue<SchedJob> & pending() const { return _pending; }
+  size_t nb_running() const { return _nb_running; }
+
+  // Appends a created job to the pending queue
+  void queue(SchedJob * job);
+  // Moves a pending job to the running jobs
+  void start(SchedJob * job);
+  // Returns the running job of id job_id, or nullptr
+  SchedJob * find_running(std::string_view job_id) const;
+  // Whether the job of handle is running
+  bool is_running(JobHandle handle) const { return handle < _running.size() && _running[handle]; }
+  // Removes the running job of id job_id from the running jobs and returns it, or nullptr.
+  // The caller destroys it.
+  SchedJob * finish(std::string_view job_id);
+
+  // Destroys all jobs
+  void clear();
+
+private:
+  ObjectPool<SchedJob> _pool;
+  std::unordered_map<std::string_view, JobHandle> _handles; // views of the ids of the known jobs
+  std::vector<SchedJob *> _jobs;       // by handle, nullptr if the handle is free
+  std::vector<bool> _running;          // by handle
+  std::vector<JobHandle> _free_handles;
+  size_t _nb_running = 0;
+
+  WaitQueue<SchedJob> _pending;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Slab allocator of objects of type T.
+ * @details Objects are constructed in slabs of SLAB_SIZE slots, destroyed objects give their slot
+ *          back to a free list, and all slabs are released at once when the pool is destroyed.
+ *          Objects still alive at that time are not destructed: the owner destroys them first.
+ */
+template <typename T, size_t SLAB_SIZE = 1024>
+class ObjectPool {
+  union Slot {
+    Slot * next_free;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+public:
+  ObjectPool() = default;
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool & operator=(const ObjectPool &) = delete;
+
+  template <typename... Args>
+  T * create(Args &&... args) {
+    if (_free == nullptr) {
+      add_slab();
+    }
+    Slot * slot = _free;
+    _free = slot->next_free;
+    ++_nb_alive;
+    return new (slot->storage) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T * object) {
+    object->~T();
+    Slot * slot = reinterpret_cast<Slot *>(object);
+    slot->next_free = _free;
+    _free = slot;
+    --_nb_alive;
+  }
+
+  size_t nb_alive() const { return _nb_alive; }
+  size_t capacity() const { return _slabs.size() * SLAB_SIZE; }
+
+private:
+  void add_slab() {
+    _slabs.emplace_back(new Slot[SLAB_SIZE]);
+    Slot * slab = _slabs.back().get();
+    for (size_t i = SLAB_SIZE; i-- > 0;) {
+      slab[i].next_free = _free;
+      _free = &slab[i];
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<Slot[]>> _slabs;
+  Slot * _free = nullptr;
+  size_t _nb_alive = 0;
+};
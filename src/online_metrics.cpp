@@ -0,0 +1,116 @@
+#include "online_metrics.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include <nlohmann/json.hpp>
+
+#include "edc_log.hpp"
+
+void OnlineMetrics::enable(const std::string & path, double max_host_power) {
+  _path = path;
+  _max_host_power = max_host_power;
+}
+
+void OnlineMetrics::reset(uint32_t nb_hosts, double idle_power) {
+  std::string path = _path;
+  double max_host_power = _max_host_power;
+  *this = OnlineMetrics();
+  _path = path;
+  _max_host_power = max_host_power;
+
+  _nb_hosts = nb_hosts;
+  _idle_power = idle_power;
+}
+
+void OnlineMetrics::on_job_completed(uint32_t nb_hosts, double power_increase, double submission_time,
+                                     double start_time, double walltime, double now, bool success) {
+  ++_nb_completed;
+  _makespan = std::max(_makespan, now);
+  _time_computing += nb_hosts * (now - start_time);
+  _job_energy += power_increase * (now - start_time);
+  _waiting_time += start_time - submission_time;
+
+  if (success) {
+    ++_nb_successful;
+    // jobs without walltime have the slowdown of an immediate start
+    _bsld += (walltime > 0) ? std::max((now - submission_time) / walltime, 1.0) : 1.0;
+  }
+}
+
+void OnlineMetrics::on_sleep_power_changed(double now, double difference) {
+  _sleep_energy += _sleep_difference * (now - _sleep_since);
+  _sleep_difference = difference;
+  _sleep_since = now;
+}
+
+double OnlineMetrics::utilization() const {
+  return (_makespan > 0) ? _time_computing / (_nb_hosts * _makespan) : 0.0;
+}
+
+double OnlineMetrics::energy() const {
+  double sleep_energy = _sleep_energy + _sleep_difference * std::max(0.0, _makespan - _sleep_since);
+  return _idle_power * _makespan + _job_energy + sleep_energy;
+}
+
+double OnlineMetrics::norm_energy() const {
+  double max_energy = _nb_hosts * _max_host_power * std::max(_makespan, 1.0);
+  return (max_energy > 0) ? energy() / max_energy : 0.0;
+}
+
+double OnlineMetrics::avg_bsld() const {
+  return (_nb_successful > 0) ? _bsld / _nb_successful : 0.0;
+}
+
+bool OnlineMetrics::dump(const char * policy) const {
+  if (!enabled()) {
+    return true;
+  }
+
+  FILE * file = fopen(_path.c_str(), "w");
+  if (file == nullptr) {
+    LOG_ERROR("Cannot write metrics to '%s'\n", _path.c_str());
+    return false;
+  }
+
+  double avg_waiting_time = (_nb_completed > 0) ? _waiting_time / _nb_completed : 0.0;
+  fprintf(file, "{\"policy\": \"%s\", \"nb_hosts\": %u, \"nb_jobs_submitted\": %" PRIu64
+          ", \"nb_jobs_rejected\": %" PRIu64 ", \"nb_jobs_completed\": %" PRIu64
+          ", \"nb_jobs_successful\": %" PRIu64 ", \"makespan\": %.17g, \"time_computing\": %.17g"
+          ", \"time_idle\": %.17g, \"utilization\": %.17g, \"energy\": %.17g, \"norm_energy\": %.17g"
+          ", \"avg_waiting_time\": %.17g, \"avg_bsld\": %.17g}\n",
+          policy, _nb_hosts, _nb_submitted, _nb_rejected, _nb_completed, _nb_successful, _makespan,
+          _time_computing, time_idle(), utilization(), energy(), norm_energy(), avg_waiting_time, avg_bsld());
+
+  bool ok = (ferror(file) == 0);
+  return (fclose(file) == 0) && ok;
+}
+
+void OnlineMetrics::save(nlohmann::json & state) const {
+  state = {
+    {"nb_hosts", _nb_hosts}, {"idle_power", _idle_power},
+    {"nb_submitted", _nb_submitted}, {"nb_rejected", _nb_rejected},
+    {"nb_completed", _nb_completed}, {"nb_successful", _nb_successful},
+    {"makespan", _makespan}, {"time_computing", _time_computing}, {"job_energy", _job_energy},
+    {"sleep_energy", _sleep_energy}, {"sleep_difference", _sleep_difference}, {"sleep_since", _sleep_since},
+    {"waiting_time", _waiting_time}, {"bsld", _bsld},
+  };
+}
+
+void OnlineMetrics::restore(const nlohmann::json & state) {
+  state.at("nb_hosts").get_to(_nb_hosts);
+  state.at("idle_power").get_to(_idle_power);
+  state.at("nb_submitted").get_to(_nb_submitted);
+  state.at("nb_rejected").get_to(_nb_rejected);
+  state.at("nb_completed").get_to(_nb_completed);
+  state.at("nb_successful").get_to(_nb_successful);
+  state.at("makespan").get_to(_makespan);
+  state.at("time_computing").get_to(_time_computing);
+  state.at("job_energy").get_to(_job_energy);
+  state.at("sleep_energy").get_to(_sleep_energy);
+  state.at("sleep_difference").get_to(_sleep_difference);
+  state.at("sleep_since").get_to(_sleep_since);
+  state.at("waiting_time").get_to(_waiting_time);
+  state.at("bsld").get_to(_bsld);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json_fwd.hpp>
+
+/**
+ * @brief Scheduling metrics of the simulation, the ones of analyze.py: utilization, normalized
+ *        energy and average bounded slowdown.
+ * @details They are kept incrementally, in O(1) per submitted and completed job, and written as
+ *          a single JSON object when the component is deinitialized. No per-job export of Batsim
+ *          needs to be read back. The energy is estimated from the idle power of the platform and
+ *          the power each job added to it while running, at the powers of the resource index,
+ *          and from the power the sleeping hosts saved.
+ */
+class OnlineMetrics {
+public:
+  // Writes the summary to path at deinitialization. Energies are normalized by the energy of
+  // all the hosts computing at max_host_power (W) during the whole makespan.
+  void enable(const std::string & path, double max_host_power);
+  bool enabled() const { return !_path.empty(); }
+
+  // Starts the metrics of a platform of nb_hosts hosts, of estimated power idle_power when idle (W)
+  void reset(uint32_t nb_hosts, double idle_power);
+
+  void on_job_submitted() { ++_nb_submitted; }
+  void on_job_rejected() { ++_nb_rejected; }
+  // A job of nb_hosts hosts, adding power_increase (W) to the platform, ran from start_time
+  // until now, successfully or not
+  void on_job_completed(uint32_t nb_hosts, double power_increase, double submission_time, double start_time,
+                        double walltime, double now, bool success);
+
+  // From now on, the sleeping hosts draw difference (W) more than they would idle,
+  // see ResourceIndex::sleep_power_saving()
+  void on_sleep_power_changed(double now, double difference);
+
+  double makespan() const { return _makespan; }
+  double time_computing() const { return _time_computing; }
+  double time_idle() const { return _nb_hosts * _makespan - _time_computing; }
+  double utilization() const;
+  double energy() const;
+  double norm_energy() const;
+  // Average of max(turnaround / walltime, 1) over the successful jobs
+  double avg_bsld() const;
+
+  // Writes the summary to the file given to enable(). Returns false on error.
+  bool dump(const char * policy) const;
+
+  // Metrics accumulated so far, for snapshots (see SchedEngine::save_snapshot()), and back.
+  // The output file and the normalization are not part of them. restore() throws
+  // nlohmann::json::exception if state is invalid.
+  void save(nlohmann::json & state) const;
+  void restore(const nlohmann::json & state);
+
+private:
+  std::string _path;
+  double _max_host_power = 0;
+
+  uint32_t _nb_hosts = 0;
+  double _idle_power = 0;
+
+  uint64_t _nb_submitted = 0;
+  uint64_t _nb_rejected = 0;
+  uint64_t _nb_completed = 0;
+  uint64_t _nb_successful = 0;
+  double _makespan = 0;       // Completion time of the last job
+  double _time_computing = 0; // Host-seconds spent computing
+  double _job_energy = 0;     // Energy added by the jobs to the idle platform (J)
+  double _sleep_energy = 0;   // Energy added by the sleeping hosts until _sleep_since, negative (J)
+  double _sleep_difference = 0;
+  double _sleep_since = 0;
+  double _waiting_time = 0;   // Sum over the completed jobs
+  double _bsld = 0;           // Sum over the successful jobs
+};
@@ -0,0 +1,66 @@
+#include "queue_arrays.hpp"
+
+void QueueArrays::push_back(SchedJob * job) {
+  // holes are reclaimed once they are the majority
+  if (_nb_holes > 64 && 2 * _nb_holes > _jobs.size()) {
+    compact();
+  }
+
+  if (job->handle >= _index.size()) {
+    _index.resize(job->handle + 1, NO_INDEX);
+  }
+  _index[job->handle] = static_cast<uint32_t>(_jobs.size());
+  _jobs.push_back(job);
+  _nb_hosts.push_back(job->nb_hosts);
+  _walltime.push_back(job->walltime);
+  _energy.push_back(job->estimated_energy);
+}
+
+void QueueArrays::erase(const SchedJob * job) {
+  size_t slot = index_of(job->handle);
+  if (slot == size()) {
+    return;
+  }
+  _jobs[slot] = nullptr;
+  _index[job->handle] = NO_INDEX;
+  ++_nb_holes;
+
+  // the last jobs are usually the last ones submitted, their slots are reused right away
+  while (!_jobs.empty() && _jobs.back() == nullptr) {
+    _jobs.pop_back();
+    _nb_hosts.pop_back();
+    _walltime.pop_back();
+    _energy.pop_back();
+    --_nb_holes;
+  }
+}
+
+void QueueArrays::clear() {
+  _jobs.clear();
+  _nb_hosts.clear();
+  _walltime.clear();
+  _energy.clear();
+  _index.clear();
+  _nb_holes = 0;
+}
+
+void QueueArrays::compact() {
+  size_t kept = 0;
+  for (size_t slot = 0; slot < _jobs.size(); ++slot) {
+    SchedJob * job = _jobs[slot];
+    if (job == nullptr) {
+      continue;
+    }
+    _jobs[kept] = job;
+    _nb_hosts[kept] = _nb_hosts[slot];
+    _walltime[kept] = _walltime[slot];
+    _energy[kept] = _energy[slot];
+    _index[job->handle] = static_cast<uint32_t>(kept);
+    ++kept;
+  }
+  _jobs.resize(kept);
+  _nb_hosts.resize(kept);
+  _walltime.resize(kept);
+  _energy.resize(kept);
+  _nb_holes = 0;
+}
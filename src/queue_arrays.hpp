@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "job_store.hpp"
+#include "worker_pool.hpp"
+
+/**
+ * @brief Structure-of-arrays copy of the pending queue (nb_hosts, walltime, estimated_energy),
+ *        whose launch conditions are evaluated in parallel for very large queues.
+ * @details Jobs are appended in FCFS order once submitted, and erased in O(1) when launched,
+ *          leaving a hole. Holes are compacted away when jobs are appended, never during a scan.
+ *
+ *          filter() gives a verdict per job on the threads of a WorkerPool. The predicate may
+ *          only read the arrays and state that does not change during the scan, e.g. the free
+ *          hosts and energy at its start, so that it is a necessary condition for the job to
+ *          start. The policy then goes through the selected jobs sequentially, in FCFS order,
+ *          and checks them again as it launches them: the decisions do not depend on the threads.
+ */
+class QueueArrays {
+public:
+  enum Verdict : uint8_t {
+    DROP,      // The job cannot start in this scan
+    KEEP,      // The job may start, to be checked again when launching it
+    NO_ENERGY, // The job fits but lacks energy (or power)
+  };
+
+  // Energy above which a job lacks energy, given the EnergyLedger::headroom() at the start of the
+  // scan. The margin covers the rounding of EnergyLedger::earliest_start(), so no job that may
+  // start is dropped.
+  static double energy_limit(double headroom) {
+    return headroom + 1e-6 + 1e-9 * (headroom < 0 ? -headroom : headroom);
+  }
+
+  // Appends a pending job, after the others
+  void push_back(SchedJob * job);
+  // Removes a job appended before, e.g. once launched
+  void erase(const SchedJob * job);
+  void clear();
+
+  // Number of slots, holes included
+  size_t size() const { return _jobs.size(); }
+  // Slot of a pending job, or size() if it is not in the arrays
+  size_t index_of(JobHandle handle) const {
+    return (handle < _index.size() && _index[handle] != NO_INDEX) ? _index[handle] : size();
+  }
+
+  /**
+   * @brief Sets the verdict of the jobs from slot first on to verdict_of(nb_hosts, walltime,
+   *        estimated_energy), in parallel on pool.
+   * @return The slots of the jobs not dropped, in FCFS order, valid until the next filter().
+   */
+  template <typename Predicate>
+  const std::vector<uint32_t> & filter(WorkerPool & pool, size_t first, const Predicate & verdict_of) {
+    _verdicts.resize(_jobs.size());
+    first = (first < _jobs.size()) ? first : _jobs.size();
+    pool.run(_jobs.size() - first, [&](size_t begin, size_t end) {
+      for (size_t i = first + begin; i < first + end; ++i) {
+        _verdicts[i] = (_jobs[i] == nullptr) ? DROP : verdict_of(_nb_hosts[i], _walltime[i], _energy[i]);
+      }
+    });
+
+    _selected.clear();
+    for (size_t i = first; i < _jobs.size(); ++i) {
+      if (_verdicts[i] != DROP) {
+        _selected.push_back(static_cast<uint32_t>(i));
+      }
+    }
+    return _selected;
+  }
+
+  // Job of a slot selected by the last filter() and its verdict. The job may have been launched
+  // since, the slot then holds nullptr.
+  SchedJob * job(uint32_t slot) const { return _jobs[slot]; }
+  Verdict verdict(uint32_t slot) const { return static_cast<Verdict>(_verdicts[slot]); }
+
+private:
+  static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+  // Moves the jobs over the holes, keeping their order
+  void compact();
+
+private:
+  std::vector<SchedJob *> _jobs; // nullptr for holes
+  std::vector<uint32_t> _nb_hosts;
+  std::vector<double> _walltime;
+  std::vector<double> _energy;
+  std::vector<uint32_t> _index;   // slot by job handle
+  size_t _nb_holes = 0;
+
+  std::vector<uint8_t> _verdicts; // by slot, the threads write disjoint ranges
+  std::vector<uint32_t> _selected;
+};
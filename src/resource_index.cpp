@@ -0,0 +1,192 @@
+#include "resource_index.hpp"
+
+#include <algorithm>
+
+double SleepConfig::break_even_time(double idle_power) const {
+  if (idle_power <= off_power) {
+    return AvailabilityProfile::NEVER;
+  }
+  // asleep for a time t, transitions included: E_off + E_on + P_off * (t - t_off - t_on) < P_idle * t
+  double transitions_time = switch_off_time + switch_on_time;
+  double transitions_energy = switch_off_power() * switch_off_time + switch_on_power() * switch_on_time;
+  return std::max(transitions_time, (transitions_energy - off_power * transitions_time) / (idle_power - off_power));
+}
+
+void ResourceIndex::set_host_power(double computing_power, double idle_power) {
+  _host_computing_power = computing_power;
+  _host_idle_power = idle_power;
+}
+
+void ResourceIndex::set_contiguous(bool contiguous, bool fragmented_fallback) {
+  _contiguous = contiguous;
+  _fragmented_fallback = fragmented_fallback;
+}
+
+void ResourceIndex::reset(uint32_t nb_hosts) {
+  HostPowerTable powers;
+  powers.reset(nb_hosts, _host_computing_power, _host_idle_power);
+  powers.build();
+  reset(powers);
+}
+
+void ResourceIndex::reset(const HostPowerTable & powers) {
+  _powers = powers;
+  _hosts.reset(_powers.nb_hosts());
+  _computing_power = 0;
+  _idle_power = _powers.total_idle_power();
+
+  // no host is asleep
+  HostAllocation awake;
+  _asleep.reset(_powers.nb_hosts());
+  _asleep.take(_powers.nb_hosts(), awake);
+  _nb_sleeping = 0;
+  _nb_switching_on = 0;
+  _sleep_power = 0;
+  _sleep_idle_power = 0;
+
+  _availability.reset(_powers.nb_hosts(), power());
+  double mean_idle_power = (_powers.nb_hosts() > 0) ? _powers.total_idle_power() / _powers.nb_hosts() : 0.0;
+  _availability.set_wake(_sleep.switch_on_time, mean_idle_power - _sleep.off_power);
+}
+
+double ResourceIndex::power_increase(uint32_t nb_hosts) const {
+  return _powers.uniform() ? power_increase(UniformPower(_powers), nb_hosts)
+                           : power_increase(HostTablePower(_powers), nb_hosts);
+}
+
+bool ResourceIndex::select(uint32_t nb_hosts, HostAllocation & allocation) const {
+  if (!_contiguous) {
+    return _hosts.find(nb_hosts, allocation);
+  }
+  uint32_t first = _hosts.find_contiguous(nb_hosts);
+  if (first < _hosts.nb_hosts()) {
+    allocation.append(first, first + nb_hosts - 1);
+    return true;
+  }
+  return (nb_hosts == 0) || (_fragmented_fallback && _hosts.find(nb_hosts, allocation));
+}
+
+bool ResourceIndex::allocate(uint32_t nb_hosts, double expected_end, HostAllocation & allocation) {
+  // power of the hosts taken, the allocation may already hold others
+  double computing = -_powers.computing_power(allocation);
+  double idle = -_powers.idle_power(allocation);
+  double increase = -_powers.increase(allocation);
+  bool allocated = _contiguous ? _hosts.take_contiguous(nb_hosts, allocation, _fragmented_fallback)
+                               : _hosts.take(nb_hosts, allocation);
+  if (!allocated) {
+    return false;
+  }
+
+  computing += _powers.computing_power(allocation);
+  idle += _powers.idle_power(allocation);
+  increase += _powers.increase(allocation);
+  _computing_power += computing;
+  _idle_power -= idle;
+  _availability.add_job(expected_end, nb_hosts, increase);
+  return true;
+}
+
+bool ResourceIndex::allocate(const HostAllocation & allocation, double expected_end) {
+  if (!_hosts.take(allocation)) {
+    return false;
+  }
+  _computing_power += _powers.computing_power(allocation);
+  _idle_power -= _powers.idle_power(allocation);
+  _availability.add_job(expected_end, allocation.nb_hosts, _powers.increase(allocation));
+  return true;
+}
+
+void ResourceIndex::release(const HostAllocation & allocation, double expected_end) {
+  _hosts.release(allocation);
+  _computing_power -= _powers.computing_power(allocation);
+  _idle_power += _powers.idle_power(allocation);
+  _availability.remove_job(expected_end, allocation.nb_hosts, _powers.increase(allocation));
+}
+
+void ResourceIndex::extend(const HostAllocation & allocation, double expected_end, double new_end) {
+  double increase = _powers.increase(allocation);
+  _availability.remove_job(expected_end, allocation.nb_hosts, increase);
+  _availability.add_job(new_end, allocation.nb_hosts, increase);
+}
+
+bool ResourceIndex::switch_off(uint32_t nb_hosts, HostAllocation & allocation) {
+  HostAllocation hosts;
+  if (!_hosts.find(nb_hosts, hosts)) {
+    return false;
+  }
+  switch_off(hosts);
+  for (const HostRange & range : hosts.ranges) {
+    allocation.append(range.first, range.last);
+  }
+  return true;
+}
+
+bool ResourceIndex::switch_off(const HostAllocation & allocation) {
+  if (!_hosts.take(allocation)) {
+    return false;
+  }
+
+  double idle = _powers.idle_power(allocation);
+  double transition = allocation.nb_hosts * _sleep.switch_off_power();
+  _nb_sleeping += allocation.nb_hosts;
+  _idle_power -= idle;
+  _sleep_power += transition;
+  _sleep_idle_power += idle;
+  _availability.sleep_hosts(allocation.nb_hosts);
+  _availability.add_power(transition - idle);
+  return true;
+}
+
+void ResourceIndex::switched_off(const HostAllocation & allocation) {
+  for (const HostRange & range : allocation.ranges) {
+    _asleep.release(range.first, range.last);
+  }
+  double change = allocation.nb_hosts * (_sleep.off_power - _sleep.switch_off_power());
+  _sleep_power += change;
+  _availability.add_power(change);
+}
+
+bool ResourceIndex::switch_on(uint32_t nb_hosts, double ready_time, HostAllocation & allocation) {
+  HostAllocation woken;
+  if (!_asleep.find(nb_hosts, woken)) {
+    return false;
+  }
+  switch_on(woken, ready_time);
+  for (const HostRange & range : woken.ranges) {
+    allocation.append(range.first, range.last);
+  }
+  return true;
+}
+
+bool ResourceIndex::switch_on(const HostAllocation & allocation, double ready_time) {
+  if (!_asleep.take(allocation)) {
+    return false;
+  }
+
+  // the hosts are free again once ready, until then they draw the transition power
+  uint32_t nb_hosts = allocation.nb_hosts;
+  double transition = nb_hosts * _sleep.switch_on_power();
+  double idle = _powers.idle_power(allocation);
+  _nb_switching_on += nb_hosts;
+  _sleep_power += transition - nb_hosts * _sleep.off_power;
+  _availability.wake_hosts(nb_hosts);
+  _availability.add_power(idle - nb_hosts * _sleep.off_power);
+  _availability.add_job(ready_time, nb_hosts, transition - idle);
+  return true;
+}
+
+void ResourceIndex::switched_on(const HostAllocation & allocation, double ready_time) {
+  double transition = allocation.nb_hosts * _sleep.switch_on_power();
+  double idle = _powers.idle_power(allocation);
+  _hosts.release(allocation);
+  _nb_sleeping -= allocation.nb_hosts;
+  _nb_switching_on -= allocation.nb_hosts;
+  _idle_power += idle;
+  _sleep_power -= transition;
+  _sleep_idle_power -= idle;
+  if (_nb_sleeping == 0) {
+    _sleep_power = 0; // without the rounding errors
+    _sleep_idle_power = 0;
+  }
+  _availability.remove_job(ready_time, allocation.nb_hosts, transition - idle);
+}
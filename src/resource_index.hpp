@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+
+#include "availability_profile.hpp"
+#include "host_index.hpp"
+#include "host_power.hpp"
+
+// Sleep pstate of the hosts and the transitions to and from it, see ResourceIndex::switch_off()
+struct SleepConfig {
+  uint32_t awake_pstate = 0;     // Pstates of the hosts for Batsim
+  uint32_t sleep_pstate = 1;
+  double off_power = 9.75;       // Power of a sleeping host (W)
+  double switch_off_time = 0;    // Duration of the transitions of a host (s)
+  double switch_on_time = 0;
+  double switch_off_energy = 0;  // Energy a host takes during the transitions (J)
+  double switch_on_energy = 0;
+
+  // Power of a host during the transitions (W), the transitions without duration take no energy
+  double switch_off_power() const { return (switch_off_time > 0) ? switch_off_energy / switch_off_time : off_power; }
+  double switch_on_power() const { return (switch_on_time > 0) ? switch_on_energy / switch_on_time : off_power; }
+  // Shortest idle time worth sleeping through for a host of idle_power (W), transitions included.
+  // NEVER if sleeping saves no power.
+  double break_even_time(double idle_power) const;
+};
+
+/**
+ * @brief Hosts of the platform: which ones are free now, when the busy ones get free,
+ *        and the estimated power of the platform.
+ * @details The power estimate is maintained incrementally as hosts are allocated and released,
+ *          from the power of each host (see HostPowerTable): host_computing_power() and
+ *          host_idle_power() for all of them unless reset() is given the powers of each host.
+ *
+ *          Free hosts may be switched off to a sleep pstate (see SleepConfig), they are then neither
+ *          free nor busy until they are switched on and ready again.
+ */
+class ResourceIndex {
+public:
+  // Estimated power of a computing and of an idle host (W), used from the next reset()
+  void set_host_power(double computing_power, double idle_power);
+  // Powers and transitions of the sleep pstate, used from the next reset()
+  void set_sleep(const SleepConfig & sleep) { _sleep = sleep; }
+  const SleepConfig & sleep() const { return _sleep; }
+  // Allocate a contiguous block first, falling back to fragmented hosts if fragmented_fallback is set
+  void set_contiguous(bool contiguous, bool fragmented_fallback);
+
+  // Resizes the platform to nb_hosts idle hosts
+  void reset(uint32_t nb_hosts);
+  // Resizes the platform to the idle hosts of powers, built
+  void reset(const HostPowerTable & powers);
+
+  uint32_t nb_hosts() const { return _hosts.nb_hosts(); }
+  uint32_t nb_free() const { return _hosts.nb_free(); }
+  uint32_t nb_busy() const { return _hosts.nb_used() - _nb_sleeping; }
+  // Hosts asleep or switching off or on, the ones of them asleep, which can be switched on, and
+  // the ones switching on
+  uint32_t nb_sleeping() const { return _nb_sleeping; }
+  uint32_t nb_asleep() const { return _asleep.nb_free(); }
+  uint32_t nb_switching_on() const { return _nb_switching_on; }
+
+  // Power of a computing and of an idle host given to set_host_power(), the default of the hosts
+  double host_computing_power() const { return _host_computing_power; }
+  double host_idle_power() const { return _host_idle_power; }
+  const HostPowerTable & host_powers() const { return _powers; }
+  // Estimated power of the platform (W)
+  double power() const { return _computing_power + _idle_power + _sleep_power; }
+  double computing_power() const { return _computing_power; }
+  double idle_power() const { return _idle_power; }
+  // Power of the sleeping hosts, minus the one they would draw idle (W): negative when it saves power
+  double sleep_power_saving() const { return _sleep_power - _sleep_idle_power; }
+  // Power added to the platform by nb_hosts hosts that start computing now, the ones allocate()
+  // would take (W). If they are not free, the largest increase of any nb_hosts hosts.
+  double power_increase(uint32_t nb_hosts) const;
+  // The same with the power model of host_powers() (see host_power.hpp), which knows whether
+  // the hosts taken matter
+  template <typename Power>
+  double power_increase(const Power & power, uint32_t nb_hosts) const {
+    if constexpr (!Power::PER_HOST) {
+      return power.max_increase(nb_hosts);
+    } else {
+      _selected.clear();
+      return select(nb_hosts, _selected) ? power.increase(_selected) : power.max_increase(nb_hosts);
+    }
+  }
+  // Bounds of the power added by any nb_hosts hosts that start computing (W)
+  double min_power_increase(uint32_t nb_hosts) const { return _powers.min_increase(nb_hosts); }
+  double max_power_increase(uint32_t nb_hosts) const { return _powers.max_increase(nb_hosts); }
+  // Estimated computing power of nb_hosts hosts not chosen yet, e.g. for energy estimates (W)
+  double job_power(uint32_t nb_hosts) const { return _powers.mean_computing_power(nb_hosts); }
+  // Incremental power sums of the estimate (W), kept by snapshots: restored once the hosts of the
+  // snapshot are allocated again, the estimates do not differ from the snapshot run by rounding
+  struct PowerSums {
+    double computing;
+    double idle;
+    double sleep;
+    double sleep_idle;
+  };
+  PowerSums power_sums() const { return {_computing_power, _idle_power, _sleep_power, _sleep_idle_power}; }
+  void restore_power_sums(const PowerSums & sums) {
+    _computing_power = sums.computing;
+    _idle_power = sums.idle;
+    _sleep_power = sums.sleep;
+    _sleep_idle_power = sums.sleep_idle;
+  }
+
+  /**
+   * @brief Allocates nb_hosts hosts until expected_end and appends them to allocation.
+   * @return False and allocates nothing if the hosts are not available.
+   */
+  bool allocate(uint32_t nb_hosts, double expected_end, HostAllocation & allocation);
+  // Allocates the hosts of allocation until expected_end, e.g. the ones of a restored job.
+  // Returns false and allocates nothing if one of them is not free.
+  bool allocate(const HostAllocation & allocation, double expected_end);
+  // Releases the hosts of an allocation made with the same expected_end
+  void release(const HostAllocation & allocation, double expected_end);
+  // The hosts of an allocation made with expected_end are now expected to be released at new_end
+  void extend(const HostAllocation & allocation, double expected_end, double new_end);
+
+  /**
+   * @brief Switches nb_hosts free hosts off and appends them to allocation, the lowest ones.
+   * @return False and switches nothing if fewer hosts are free.
+   */
+  bool switch_off(uint32_t nb_hosts, HostAllocation & allocation);
+  // Switches the free hosts of allocation off, false and nothing switched if one of them is not free
+  bool switch_off(const HostAllocation & allocation);
+  // The hosts of a switch_off() allocation are asleep
+  void switched_off(const HostAllocation & allocation);
+  /**
+   * @brief Switches nb_hosts asleep hosts on and appends them to allocation, they are ready at ready_time.
+   * @return False and switches nothing if fewer hosts are asleep.
+   */
+  bool switch_on(uint32_t nb_hosts, double ready_time, HostAllocation & allocation);
+  // Switches the asleep hosts of allocation on, false and nothing switched if one of them is not asleep
+  bool switch_on(const HostAllocation & allocation, double ready_time);
+  // The hosts of a switch_on() allocation made with the same ready_time are free again
+  void switched_on(const HostAllocation & allocation, double ready_time);
+
+  const HostIndex & hosts() const { return _hosts; }
+  // Index whose free hosts are the asleep ones
+  const HostIndex & asleep() const { return _asleep; }
+  const AvailabilityProfile & availability() const { return _availability; }
+
+  // EASY reservation of nb_hosts hosts that start computing, see AvailabilityProfile::reserve().
+  // Their hosts are not known yet: the largest power increase is reserved.
+  AvailabilityProfile::Reservation reserve(double now, uint32_t nb_hosts,
+                                           double power_limit = AvailabilityProfile::NEVER,
+                                           double not_before = 0) const {
+    return _availability.reserve(now, nb_hosts, max_power_increase(nb_hosts), power_limit, not_before);
+  }
+
+private:
+  // Appends the hosts allocate() would take to allocation, without taking them
+  bool select(uint32_t nb_hosts, HostAllocation & allocation) const;
+
+  HostIndex _hosts;
+  HostIndex _asleep; // The free hosts there are the asleep ones
+  AvailabilityProfile _availability;
+  bool _contiguous = false;
+  bool _fragmented_fallback = true;
+
+  double _host_computing_power = 0;
+  double _host_idle_power = 0;
+  HostPowerTable _powers;
+  mutable HostAllocation _selected; // Hosts of the last power_increase()
+  double _computing_power = 0; // Estimated power of the busy hosts (W)
+  double _idle_power = 0;      // Estimated power of the idle hosts (W)
+
+  SleepConfig _sleep;
+  uint32_t _nb_sleeping = 0;
+  uint32_t _nb_switching_on = 0;
+  double _sleep_power = 0;      // Estimated power of the sleeping hosts (W)
+  double _sleep_idle_power = 0; // Power they would draw idle (W)
+};
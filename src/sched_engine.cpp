@@ -0,0 +1,646 @@
+#include "sched_engine.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "batsim_edc.h"
+#include "edc_config.hpp"
+#include "edc_log.hpp"
+
+using namespace batprotocol;
+
+// View of a string of the received message, valid during the call
+static inline std::string_view view_of(const flatbuffers::String * str) {
+  return std::string_view(str->data(), str->size());
+}
+
+// Prefix of the call_me_later ids of the wakeups
+static const std::string_view WAKEUP_PREFIX = "wakeup!";
+
+SchedEngine::SchedEngine(PolicyFactory make_policy) : _make_policy(make_policy) {}
+
+SchedEngine::~SchedEngine() {
+  delete _mb;
+}
+
+// Walltime of a job per host of its partition, its share of the pending work there (s)
+static double work_per_host(const SchedJob * job, uint32_t nb_hosts) {
+  return (nb_hosts == 0) ? 0 : job->nb_hosts * std::max(0.0, job->walltime) / nb_hosts;
+}
+
+uint8_t SchedEngine::init(const uint8_t * data, uint32_t size, uint32_t flags) {
+  _format_binary = ((flags & BATSIM_EDC_FORMAT_BINARY) != 0);
+  if ((flags & (BATSIM_EDC_FORMAT_BINARY | BATSIM_EDC_FORMAT_JSON)) != flags) {
+    LOG_ERROR("Unknown flags used, cannot initialize myself.\n");
+    return 1;
+  }
+
+  // read policy parameters from initialization data, see edc_config.hpp
+  nlohmann::json config;
+  std::string restore_path;
+  std::vector<PartitionConfig> partitions;
+  if (!parse_edc_config(data, size, config) ||
+      !read_log_level_config(config) ||
+      !read_stats_config(config, _stats) ||
+      !read_metrics_config(config, _metrics) ||
+      !read_parallel_config(config, _parallel_threshold, _nb_workers) ||
+      !read_config_value(config, "platform_power", _platform_power) ||
+      !read_walltime_correction_config(config, _walltime_correction, _predictor) ||
+      !read_snapshot_config(config, _snapshot_path, _snapshot_time, restore_path) ||
+      !read_partitions_config(config, partitions, _partition_property)) {
+    return 1;
+  }
+  _partitioned = !partitions.empty();
+  if (_partitioned && (!_snapshot_path.empty() || !restore_path.empty())) {
+    LOG_ERROR("Snapshots are not supported with partitions.\n");
+    return 1;
+  }
+  if (!_partitioned) {
+    partitions.push_back({"default", HostAllocation(), nlohmann::json::object()});
+  }
+
+  // each partition configures its own policy, with the keys of the platform and its own ones
+  for (PartitionConfig & partition_config : partitions) {
+    auto partition = std::make_unique<Partition>();
+    partition->name = partition_config.name;
+    partition->hosts = std::move(partition_config.hosts);
+    partition->policy.reset(_make_policy());
+    select(*partition);
+    nlohmann::json merged = config;
+    merged.update(partition_config.config);
+    if (!read_carry_over_config(merged, partition->energy) || !partition->policy->configure(*this, merged)) {
+      if (_partitioned) {
+        LOG_ERROR("Invalid configuration of partition '%s'.\n", partition->name.c_str());
+      }
+      return 1;
+    }
+    _partitions.push_back(std::move(partition));
+  }
+
+  _mb = new MessageBuilder(!_format_binary);
+  if (!restore_path.empty()) {
+    if (!restore_snapshot(restore_path)) {
+      return 1;
+    }
+    _restored = true;
+  }
+  return 0;
+}
+
+uint8_t SchedEngine::deinit() {
+  bool ok = _stats.dump();
+  ok = _metrics.dump(policy_name()) && ok;
+  return ok ? 0 : 1;
+}
+
+uint8_t SchedEngine::take_decisions(const uint8_t * what_happened, uint32_t what_happened_size,
+                                    uint8_t ** decisions, uint32_t * decisions_size) {
+  (void) what_happened_size;
+  typedef DecisionStats::Clock Clock;
+  const bool measured = _stats.enabled();
+  Clock::time_point begin, deserialized, handled, scheduled;
+  if (measured) {
+    begin = Clock::now();
+  }
+
+  // binary messages are read in place, JSON ones are parsed first (useful for debugging)
+  const fb::Message * parsed = _format_binary ? fb::GetMessage(what_happened)
+                                              : deserialize_message(*_mb, true, what_happened);
+  double now = parsed->now();
+  if (measured) {
+    deserialized = Clock::now();
+  }
+
+  // the platform power has been constant since the previous call, or the end of a pstate transition
+  for (auto & partition : _partitions) {
+    select(*partition);
+    finish_transitions(now);
+    partition->energy.advance(now, partition->resources.power());
+  }
+  _mb->clear(now);
+  _nb_launched = 0;
+
+  auto nb_events = parsed->events()->size();
+  for (unsigned int i = 0; i < nb_events; ++i) {
+    auto event = (*parsed->events())[i];
+    LOG_DEBUG("%s received event type='%s'\n", policy_name(), fb::EnumNamesEvent()[event->event_type()]);
+
+    switch (event->event_type()) {
+      // protocol handshake
+      case fb::Event_BatsimHelloEvent: {
+        _mb->add_edc_hello(policy_name(), _partitions.front()->policy->version());
+      } break;
+      // the platform is known, all hosts are idle
+      case fb::Event_SimulationBeginsEvent: {
+        // Batsim simulates from time 0: resetting the hosts, ledger and predictor would leave the
+        // restored jobs on allocations the hosts no longer know
+        if (_restored) {
+          LOG_ERROR("The simulation begins after restoring a snapshot, restore_file is only supported "
+                    "by edc_replay --restore.\n");
+          return 1;
+        }
+        _predictor.reset();
+        reset_hosts(event->event_as_SimulationBeginsEvent());
+        uint32_t nb_hosts = 0;
+        double idle_power = 0;
+        for (auto & partition : _partitions) {
+          nb_hosts += partition->resources.nb_hosts();
+          idle_power += partition->resources.host_powers().total_idle_power();
+        }
+        _metrics.reset(nb_hosts, idle_power);
+        for (auto & partition : _partitions) {
+          select(*partition);
+          partition->transitions.clear();
+          partition->estimated_ends.clear();
+          partition->energy.reset(now);
+          partition->changes |= SIMULATION_BEGINS;
+          partition->policy->on_simulation_begins(*this, now);
+        }
+      } break;
+      case fb::Event_JobSubmittedEvent: {
+        handle_job_submitted(event->event_as_JobSubmittedEvent(), now);
+      } break;
+      case fb::Event_JobCompletedEvent: {
+        handle_job_completed(event->event_as_JobCompletedEvent(), now);
+      } break;
+      case fb::Event_RequestedCallEvent: {
+        handle_requested_call(event->event_as_RequestedCallEvent(), now);
+      } break;
+      default: break;
+    }
+  }
+
+  for (auto & partition : _partitions) {
+    select(*partition);
+    // the jobs completing now are released before the others are found overdue
+    extend_estimates(now);
+    // projections of the energy account start from the platform left by the events
+    partition->energy.set_power(partition->resources.power());
+    check_energy(now);
+  }
+  if (measured) {
+    handled = Clock::now();
+  }
+
+  for (auto & partition : _partitions) {
+    select(*partition);
+    // the pass is skipped if nothing it depends on changed, the decisions are then empty
+    if (partition->changes != NO_CHANGE) {
+      partition->due_time = EnergyLedger::NEVER; // the policy requests its wakeups again
+      partition->policy->schedule(*this, now);
+      partition->changes = NO_CHANGE;
+      partition->first_submitted = NO_JOB;
+      partition->pass_rate = partition->energy.rate();
+      partition->pass_in_window = partition->energy.in_window(now);
+    }
+    // hosts switching pstate are ready at the end of their transition, once the wakeups received
+    // by this call are cleared
+    if (!partition->transitions.empty()) {
+      request_wakeup(partition->transitions.begin()->first, now);
+    }
+    // and running jobs are known to outlive their corrected walltime at its end
+    if (!partition->estimated_ends.empty()) {
+      request_wakeup(partition->estimated_ends.begin()->first, now);
+    }
+  }
+  // the state left by the call once its decisions are taken
+  if (now >= _snapshot_time) {
+    save_snapshot(_snapshot_path, now);
+    _snapshot_time = EnergyLedger::NEVER;
+  }
+  if (measured) {
+    scheduled = Clock::now();
+  }
+
+  // serialize decisions that have been taken into the output parameters of the function.
+  // In binary format, the builder buffer is handed over as is: it is reused by the next call.
+  _mb->finish_message(now);
+  if (_format_binary) {
+    *decisions = const_cast<uint8_t *>(_mb->buffer_pointer());
+    *decisions_size = _mb->buffer_size();
+  } else {
+    serialize_message(*_mb, true, const_cast<const uint8_t **>(decisions), decisions_size);
+  }
+
+  if (measured) {
+    DecisionStats::Record & record = _stats.next_record();
+    record.now = now;
+    record.deserialize_ns = DecisionStats::elapsed_ns(begin, deserialized);
+    record.events_ns = DecisionStats::elapsed_ns(deserialized, handled);
+    record.schedule_ns = DecisionStats::elapsed_ns(handled, scheduled);
+    record.serialize_ns = DecisionStats::elapsed_ns(scheduled, Clock::now());
+    record.nb_events = nb_events;
+    size_t queue_length = 0;
+    for (const auto & partition : _partitions) {
+      queue_length += partition->jobs.pending().size();
+    }
+    record.queue_length = static_cast<uint32_t>(queue_length);
+    record.nb_launched = _nb_launched;
+  }
+  return 0;
+}
+
+void SchedEngine::handle_job_submitted(const fb::JobSubmittedEvent * event, double now) {
+  std::string_view id = view_of(event->job_id());
+  for (const auto & partition : _partitions) {
+    if (partition->jobs.handle_of(id) != NO_JOB) {
+      LOG_WARNING("Job %s submitted twice, ignoring it\n", event->job_id()->c_str());
+      return;
+    }
+  }
+  uint32_t nb_hosts = event->job()->resource_request();
+  _metrics.on_job_submitted();
+
+  // jobs that can never run are rejected right away
+  Partition * partition = route(id, nb_hosts);
+  if (partition == nullptr) {
+    _mb->add_reject_job(event->job_id()->str());
+    _metrics.on_job_rejected();
+    return;
+  }
+
+  select(*partition);
+  SchedJob * job = partition->jobs.create(id);
+  job->nb_hosts = nb_hosts;
+  job->requested_walltime = event->job()->walltime();
+  job->walltime = _walltime_correction ? _predictor.estimate(job->nb_hosts, job->requested_walltime)
+                                       : job->requested_walltime;
+  job->submission_time = now;
+  partition->jobs.queue(job);
+  partition->pending_work += work_per_host(job, partition->resources.nb_hosts());
+  if (partition->first_submitted == NO_JOB) {
+    partition->first_submitted = job->handle;
+  }
+  partition->changes |= JOBS_SUBMITTED;
+  partition->policy->on_job_submitted(*this, job, now);
+  partition->queue_arrays.push_back(job); // with the estimated energy set by the policy
+}
+
+SchedEngine::Partition * SchedEngine::route(std::string_view job_id, uint32_t nb_hosts) {
+  std::string_view workload = job_id.substr(0, job_id.find('!'));
+  Partition * least_loaded = nullptr;
+  for (auto & partition : _partitions) {
+    bool fits = nb_hosts <= partition->resources.nb_hosts();
+    if (_partitioned && partition->name == workload) {
+      return fits ? partition.get() : nullptr;
+    }
+    if (fits && (least_loaded == nullptr || partition->pending_work < least_loaded->pending_work)) {
+      least_loaded = partition.get();
+    }
+  }
+  return least_loaded;
+}
+
+void SchedEngine::handle_job_completed(const fb::JobCompletedEvent * event, double now) {
+  std::string_view id = view_of(event->job_id());
+  SchedJob * job = nullptr;
+  for (auto & partition : _partitions) {
+    job = partition->jobs.finish(id);
+    if (job != nullptr) {
+      select(*partition);
+      break;
+    }
+  }
+  if (job == nullptr) {
+    return;
+  }
+
+  Partition & partition = *_part;
+  partition.resources.release(job->allocation, job->expected_end_time);
+  _metrics.on_job_completed(job->nb_hosts, partition.resources.host_powers().increase(job->allocation),
+                            job->submission_time, job->start_time, job->requested_walltime, now,
+                            event->state() == fb::FinalJobState_COMPLETED_SUCCESSFULLY);
+  partition.estimated_ends.erase({job->expected_end_time, job->handle});
+  if (_walltime_correction) {
+    _predictor.on_job_completed(job->nb_hosts, job->requested_walltime, now - job->start_time);
+  }
+  partition.changes |= HOSTS_FREED;
+  partition.policy->on_job_completed(*this, job, now);
+  partition.jobs.destroy(job);
+}
+
+void SchedEngine::handle_requested_call(const fb::RequestedCallEvent * event, double now) {
+  if (view_of(event->call_me_later_id()).substr(0, WAKEUP_PREFIX.size()) != WAKEUP_PREFIX) {
+    return; // not one of our wakeups
+  }
+
+  // all the wakeups due by now are received, possibly in the same message: the partitions that
+  // requested one of them are woken up. A wakeup already received with an earlier one changes
+  // nothing, check_energy() still marks the wakeups due by the policy.
+  for (auto & partition : _partitions) {
+    auto due_end = partition->wakeups.upper_bound(static_cast<uint64_t>(now));
+    if (due_end == partition->wakeups.begin()) {
+      continue;
+    }
+    partition->wakeups.erase(partition->wakeups.begin(), due_end);
+    select(*partition);
+    partition->changes |= WAKEUP;
+    partition->policy->on_wakeup(*this, now);
+  }
+}
+
+void SchedEngine::reset_hosts(const fb::SimulationBeginsEvent * event) {
+  uint32_t nb_hosts = event->computation_host_number();
+  auto hosts = event->computation_hosts();
+
+  // the hosts of each partition: all of them, the ones named by their property, or the configured
+  // ones that are in the platform
+  if (!_partitioned) {
+    _partitions.front()->hosts.clear();
+    if (nb_hosts > 0) {
+      _partitions.front()->hosts.append(0, nb_hosts - 1);
+    }
+  } else if (!_partition_property.empty()) {
+    std::vector<std::vector<uint32_t>> ids(_partitions.size());
+    for (uint32_t i = 0; hosts != nullptr && i < hosts->size(); ++i) {
+      auto host = (*hosts)[i];
+      if (host->id() >= nb_hosts || host->properties() == nullptr) {
+        continue;
+      }
+      for (uint32_t p = 0; p < host->properties()->size(); ++p) {
+        auto property = (*host->properties())[p];
+        if (view_of(property->key()) != _partition_property) {
+          continue;
+        }
+        for (size_t k = 0; k < _partitions.size(); ++k) {
+          if (view_of(property->value()) == _partitions[k]->name) {
+            ids[k].push_back(host->id());
+          }
+        }
+      }
+    }
+    for (size_t k = 0; k < _partitions.size(); ++k) {
+      std::sort(ids[k].begin(), ids[k].end());
+      ids[k].erase(std::unique(ids[k].begin(), ids[k].end()), ids[k].end());
+      _partitions[k]->hosts.clear();
+      for (uint32_t id : ids[k]) {
+        _partitions[k]->hosts.append(id, id);
+      }
+    }
+  } else {
+    for (auto & partition : _partitions) {
+      HostAllocation in_platform;
+      for (const HostRange & range : partition->hosts.ranges) {
+        if (range.first < nb_hosts) {
+          in_platform.append(range.first, std::min(range.last, nb_hosts - 1));
+        }
+      }
+      if (in_platform.nb_hosts < partition->hosts.nb_hosts) {
+        LOG_WARNING("Partition %s has hosts beyond the %u of the platform, ignoring them\n",
+                    partition->name.c_str(), nb_hosts);
+      }
+      partition->hosts = std::move(in_platform);
+    }
+  }
+  for (auto & partition : _partitions) {
+    const HostAllocation & partition_hosts = partition->hosts;
+    partition->all_hosts = (partition_hosts.nb_hosts == nb_hosts && partition_hosts.ranges.size() <= 1);
+    if (_partitioned) {
+      LOG_INFO("Partition %s: hosts %s\n", partition->name.c_str(), partition_hosts.to_string_hyphen().c_str());
+    }
+  }
+
+  if (!_platform_power || hosts == nullptr) {
+    for (auto & partition : _partitions) {
+      partition->resources.reset(partition->hosts.nb_hosts);
+    }
+    return;
+  }
+
+  // the partition of each host of the platform and its id there
+  const uint32_t NO_PARTITION = UINT32_MAX;
+  std::vector<uint32_t> partition_of(nb_hosts, NO_PARTITION);
+  std::vector<uint32_t> local_id(nb_hosts, 0);
+  for (uint32_t k = 0; k < _partitions.size(); ++k) {
+    uint32_t id = 0;
+    for (const HostRange & range : _partitions[k]->hosts.ranges) {
+      for (uint32_t host = range.first; host <= range.last; ++host) {
+        partition_of[host] = k;
+        local_id[host] = id++;
+      }
+    }
+  }
+
+  // the hosts without a wattage_per_state property keep the powers of the policy
+  std::vector<HostPowerTable> powers(_partitions.size());
+  for (size_t k = 0; k < _partitions.size(); ++k) {
+    const ResourceIndex & resources = _partitions[k]->resources;
+    powers[k].reset(_partitions[k]->hosts.nb_hosts, resources.host_computing_power(), resources.host_idle_power());
+  }
+  uint32_t nb_read = 0;
+  for (uint32_t i = 0; i < hosts->size(); ++i) {
+    auto host = (*hosts)[i];
+    if (host->id() >= nb_hosts || partition_of[host->id()] == NO_PARTITION || host->properties() == nullptr) {
+      continue;
+    }
+    for (uint32_t p = 0; p < host->properties()->size(); ++p) {
+      auto property = (*host->properties())[p];
+      if (view_of(property->key()) != "wattage_per_state") {
+        continue;
+      }
+      double computing_power = 0, idle_power = 0;
+      if (parse_wattage_per_state(property->value()->str(), host->pstate(), computing_power, idle_power)) {
+        powers[partition_of[host->id()]].set(local_id[host->id()], computing_power, idle_power);
+        ++nb_read;
+      } else {
+        LOG_WARNING("Invalid wattage_per_state '%s' of host %s, using the default powers\n",
+                    property->value()->c_str(), host->name()->c_str());
+      }
+    }
+  }
+  double idle_power = 0, computing_power = 0;
+  for (size_t k = 0; k < _partitions.size(); ++k) {
+    powers[k].build();
+    _partitions[k]->resources.reset(powers[k]);
+    idle_power += powers[k].total_idle_power();
+    computing_power += powers[k].total_computing_power();
+  }
+  LOG_INFO("Powers of %u hosts out of %u read from the platform, %g W idle, %g W computing\n",
+           nb_read, nb_hosts, idle_power, computing_power);
+}
+
+void SchedEngine::write_platform_hosts(const HostAllocation & hosts, std::string & buffer) {
+  if (_part->all_hosts) {
+    hosts.write_hyphen(buffer);
+    return;
+  }
+
+  // host i of the partition is the i-th of its ranges, both are sorted: a single merge
+  const std::vector<HostRange> & ranges = _part->hosts.ranges;
+  _platform_hosts.clear();
+  size_t r = 0;
+  uint32_t offset = 0; // Id in the partition of the first host of ranges[r]
+  for (const HostRange & range : hosts.ranges) {
+    uint32_t first = range.first;
+    while (first <= range.last) {
+      while (first - offset > ranges[r].last - ranges[r].first) {
+        offset += ranges[r].last - ranges[r].first + 1;
+        ++r;
+      }
+      uint32_t last = std::min(range.last, offset + (ranges[r].last - ranges[r].first));
+      _platform_hosts.append(ranges[r].first + (first - offset), ranges[r].first + (last - offset));
+      first = last + 1;
+    }
+  }
+  _platform_hosts.write_hyphen(buffer);
+}
+
+double SchedEngine::sleep_power_saving() const {
+  double saving = 0;
+  for (const auto & partition : _partitions) {
+    saving += partition->resources.sleep_power_saving();
+  }
+  return saving;
+}
+
+void SchedEngine::check_energy(double now) {
+  Partition & partition = *_part;
+  // a wakeup requested by the previous pass may be due before Batsim calls back for it
+  if (now >= partition.due_time) {
+    partition.changes |= WAKEUP;
+  }
+
+  const EnergyLedger & energy = partition.energy;
+  double threshold = partition.energy_threshold;
+  bool in_window = energy.in_window(now);
+  if (in_window != partition.pass_in_window || energy.rate() != partition.pass_rate || threshold < 0 ||
+      (threshold < EnergyLedger::NEVER && energy.earliest_start(threshold, now) <= now)) {
+    partition.changes |= ENERGY;
+  }
+}
+
+void SchedEngine::extend_estimates(double now) {
+  Partition & partition = *_part;
+  while (!partition.estimated_ends.empty() && partition.estimated_ends.begin()->first <= now) {
+    SchedJob * job = partition.jobs.get(partition.estimated_ends.begin()->second);
+    partition.estimated_ends.erase(partition.estimated_ends.begin());
+    double end = job->start_time + job->requested_walltime;
+    partition.resources.extend(job->allocation, job->expected_end_time, end);
+    LOG_DEBUG("Job %s outlived its walltime of %g s, expected until %g\n", job->id.c_str(), job->walltime, end);
+    job->expected_end_time = end;
+    partition.changes |= ESTIMATES_EXCEEDED;
+  }
+}
+
+void SchedEngine::finish_transitions(double now) {
+  Partition & partition = *_part;
+  while (!partition.transitions.empty() && partition.transitions.begin()->first <= now) {
+    auto it = partition.transitions.begin();
+    partition.energy.advance(it->first, partition.resources.power());
+    if (it->second.on) {
+      partition.resources.switched_on(it->second.hosts, it->first);
+    } else {
+      partition.resources.switched_off(it->second.hosts);
+    }
+    _metrics.on_sleep_power_changed(it->first, sleep_power_saving());
+    partition.transitions.erase(it);
+    partition.changes |= HOSTS_SWITCHED;
+  }
+}
+
+uint32_t SchedEngine::switch_off(uint32_t nb_hosts, double now) {
+  Partition & partition = *_part;
+  nb_hosts = std::min(nb_hosts, partition.resources.nb_free());
+  if (nb_hosts == 0) {
+    return 0;
+  }
+
+  const SleepConfig & sleep = partition.resources.sleep();
+  Transition transition{HostAllocation(), false};
+  partition.resources.switch_off(nb_hosts, transition.hosts);
+  partition.energy.set_power(partition.resources.power());
+  _metrics.on_sleep_power_changed(now, sleep_power_saving());
+  std::string platform_hosts;
+  write_platform_hosts(transition.hosts, platform_hosts);
+  _mb->add_change_host_pstate(platform_hosts, sleep.sleep_pstate);
+  LOG_DEBUG("%s switches hosts %s off\n", partition.policy->name(), platform_hosts.c_str());
+
+  double end = now + sleep.switch_off_time;
+  partition.transitions.emplace(end, std::move(transition));
+  request_wakeup(end, now);
+  return nb_hosts;
+}
+
+uint32_t SchedEngine::switch_on(uint32_t nb_hosts, double now) {
+  Partition & partition = *_part;
+  nb_hosts = std::min(nb_hosts, partition.resources.nb_asleep());
+  if (nb_hosts == 0) {
+    return 0;
+  }
+
+  const SleepConfig & sleep = partition.resources.sleep();
+  double end = now + sleep.switch_on_time;
+  Transition transition{HostAllocation(), true};
+  partition.resources.switch_on(nb_hosts, end, transition.hosts);
+  partition.energy.set_power(partition.resources.power());
+  _metrics.on_sleep_power_changed(now, sleep_power_saving());
+  std::string platform_hosts;
+  write_platform_hosts(transition.hosts, platform_hosts);
+  _mb->add_change_host_pstate(platform_hosts, sleep.awake_pstate);
+  LOG_DEBUG("%s switches hosts %s on\n", partition.policy->name(), platform_hosts.c_str());
+
+  partition.transitions.emplace(end, std::move(transition));
+  request_wakeup(end, now);
+  return nb_hosts;
+}
+
+void SchedEngine::request_wakeup(double time, double now) {
+  Partition & partition = *_part;
+  // Batsim triggers fire at whole seconds, strictly in the future
+  partition.due_time = std::min(partition.due_time, time);
+  uint64_t instant = static_cast<uint64_t>(std::ceil(std::max(time, now)));
+  if (instant <= now) {
+    ++instant;
+  }
+  if (!partition.wakeups.empty() && *partition.wakeups.begin() <= instant) {
+    return; // an earlier wakeup lets the policy request this one again
+  }
+
+  partition.wakeups.insert(instant);
+  _mb->add_call_me_later(std::string(WAKEUP_PREFIX) + std::to_string(_nb_wakeups++),
+                         TemporalTrigger::make_one_shot(instant));
+  LOG_DEBUG("%s requested a wakeup at %lu\n", partition.policy->name(), (unsigned long) instant);
+}
+
+bool SchedEngine::launch(SchedJob * job, double now) {
+  Partition & partition = *_part;
+  double expected_end_time = now + job->walltime;
+  if (!partition.resources.allocate(job->nb_hosts, expected_end_time, job->allocation)) {
+    return false;
+  }
+
+  partition.energy.set_power(partition.resources.power());
+  job->start_time = now;
+  job->expected_end_time = expected_end_time;
+  if (job->walltime < job->requested_walltime) {
+    partition.estimated_ends.emplace(expected_end_time, job->handle);
+  }
+  partition.jobs.start(job);
+  partition.queue_arrays.erase(job);
+  partition.pending_work = std::max(0.0, partition.pending_work - work_per_host(job, partition.resources.nb_hosts()));
+  write_platform_hosts(job->allocation, _hosts_buffer);
+  _mb->add_execute_job(job->job_id(), _hosts_buffer);
+  ++_nb_launched;
+  return true;
+}
+
+// The engine of the decision component
+static SchedEngine * engine = nullptr;
+
+uint8_t edc_init(PolicyFactory make_policy, const uint8_t * data, uint32_t size, uint32_t flags) {
+  delete engine;
+  engine = new SchedEngine(make_policy);
+  return engine->init(data, size, flags);
+}
+
+uint8_t edc_deinit() {
+  uint8_t status = (engine == nullptr) ? 0 : engine->deinit();
+  delete engine;
+  engine = nullptr;
+  return status;
+}
+
+uint8_t edc_take_decisions(const uint8_t * what_happened, uint32_t what_happened_size,
+                           uint8_t ** decisions, uint32_t * decisions_size) {
+  return engine->take_decisions(what_happened, what_happened_size, decisions, decisions_size);
+}
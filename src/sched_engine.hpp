@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <batprotocol.hpp>
+#include <nlohmann/json.hpp>
+
+#include "decision_stats.hpp"
+#include "energy_ledger.hpp"
+#include "job_store.hpp"
+#include "online_metrics.hpp"
+#include "queue_arrays.hpp"
+#include "resource_index.hpp"
+#include "walltime_predictor.hpp"
+#include "worker_pool.hpp"
+
+class SchedEngine;
+
+/**
+ * @brief Scheduling strategy of a decision component, run by a SchedEngine.
+ * @details The engine handles the Batsim protocol, the submitted and completed jobs,
+ *          the hosts and the energy account. The policy decides which pending jobs start.
+ */
+class Policy {
+public:
+  virtual ~Policy() = default;
+
+  // Name and version sent in the hello of the decision component
+  virtual const char * name() const = 0;
+  virtual const char * version() const { return "1.0.0"; }
+
+  // Reads the policy parameters of the initialization data and sets up the engine.
+  // Returns false if the parameters are invalid.
+  virtual bool configure(SchedEngine & engine, const nlohmann::json & config) = 0;
+
+  // The platform is known, resources and energy account are reset
+  virtual void on_simulation_begins(SchedEngine & engine, double now) { (void) engine; (void) now; }
+  // A job that fits in the platform has been queued
+  virtual void on_job_submitted(SchedEngine & engine, SchedJob * job, double now) {
+    (void) engine; (void) job; (void) now;
+  }
+  // A running job completed and its hosts are released, it is destroyed after this call
+  virtual void on_job_completed(SchedEngine & engine, SchedJob * job, double now) {
+    (void) engine; (void) job; (void) now;
+  }
+  // A wakeup requested with SchedEngine::request_wakeup is due
+  virtual void on_wakeup(SchedEngine & engine, double now) { (void) engine; (void) now; }
+
+  // Takes the decisions of the round, once all its events are handled.
+  // Only called when something changed since the previous pass, see SchedEngine::changes().
+  virtual void schedule(SchedEngine & engine, double now) = 0;
+
+  // Adds the state the policy keeps between passes to a snapshot, see SchedEngine::save_snapshot().
+  // Jobs are referred to by their id, the restored engine gives them new handles.
+  virtual void save_state(const SchedEngine & engine, nlohmann::json & state) const {
+    (void) engine; (void) state;
+  }
+  // Restores the state of save_state() once the platform, jobs and reservations of the engine are
+  // restored: on_simulation_begins() and on_job_submitted() have been called for them.
+  // Returns false if the state is invalid.
+  virtual bool restore_state(SchedEngine & engine, const nlohmann::json & state) {
+    (void) engine; (void) state;
+    return true;
+  }
+};
+
+// Creates the policy of a partition, see SchedEngine
+typedef Policy * (*PolicyFactory)();
+
+/**
+ * @brief Core of the decision components: protocol handling, job store, resource index
+ *        and energy ledger, on top of which a Policy takes the scheduling decisions.
+ * @details The engine tracks what changed since the previous scheduling pass: submitted jobs,
+ *          freed hosts, due wakeups and energy. A call that changes none of them, e.g. an
+ *          unrelated notification, skips the pass and returns empty decisions in O(1).
+ *
+ *          The hosts may be split into partitions (partitions key, see edc_config.hpp), each with
+ *          its own policy, queue, resource index and energy ledger: the partitions are scheduled
+ *          independently in the same call, a pass only runs for the partitions that changed. The
+ *          accessors below are the ones of the partition whose event or pass is handled, so
+ *          policies see their partition as the whole platform, with hosts numbered from 0.
+ */
+class SchedEngine {
+public:
+  // What changed since the previous scheduling pass, combined in changes()
+  enum Change : uint32_t {
+    NO_CHANGE = 0,
+    SIMULATION_BEGINS = 1 << 0, // The platform is known, all hosts are idle
+    JOBS_SUBMITTED = 1 << 1,    // Jobs were queued behind the ones of the previous pass
+    HOSTS_FREED = 1 << 2,       // Running jobs completed
+    WAKEUP = 1 << 3,            // A requested wakeup is due
+    ENERGY = 1 << 4,            // The energy threshold is reached, or the budget period changed
+    HOSTS_SWITCHED = 1 << 5,    // Hosts finished switching off or on
+    RESTORED = 1 << 6,          // The state was restored from a snapshot of another policy
+    ESTIMATES_EXCEEDED = 1 << 7, // Running jobs outlived their corrected walltime
+  };
+
+  // The engine owns the policies it creates, one per partition
+  explicit SchedEngine(PolicyFactory make_policy);
+  SchedEngine(const SchedEngine &) = delete;
+  SchedEngine & operator=(const SchedEngine &) = delete;
+  ~SchedEngine();
+
+  // Implementation of the EDC C API, see batsim_edc.h
+  uint8_t init(const uint8_t * data, uint32_t size, uint32_t flags);
+  uint8_t deinit();
+  uint8_t take_decisions(const uint8_t * what_happened, uint32_t what_happened_size,
+                         uint8_t ** decisions, uint32_t * decisions_size);
+
+  JobStore & jobs() { return _part->jobs; }
+  const JobStore & jobs() const { return _part->jobs; }
+  ResourceIndex & resources() { return _part->resources; }
+  EnergyLedger & energy() { return _part->energy; }
+  // Partitions of the platform, one named "default" with all the hosts unless configured
+  size_t nb_partitions() const { return _partitions.size(); }
+  const std::string & partition_name() const { return _part->name; }
+  const DecisionStats & stats() const { return _stats; }
+  const OnlineMetrics & metrics() const { return _metrics; }
+  // Whether the jobs are scheduled with corrected walltimes (walltime_correction key), see
+  // SchedJob::walltime
+  bool walltime_correction() const { return _walltime_correction; }
+  const WalltimePredictor & walltime_predictor() const { return _predictor; }
+  // Whether the powers of the hosts are read from the platform (platform_power key), see
+  // ResourceIndex::host_powers()
+  bool platform_power() const { return _platform_power; }
+  batprotocol::MessageBuilder & decisions() { return *_mb; }
+  uint32_t nb_hosts() const { return _part->resources.nb_hosts(); }
+
+  /**
+   * @brief Allocates hosts to a pending job and executes it on them.
+   * @return False if the hosts are not available, the job then stays pending.
+   */
+  bool launch(SchedJob * job, double now);
+  // Hosts of the last launched job, as sent to Batsim
+  const std::string & launched_hosts() const { return _hosts_buffer; }
+
+  /**
+   * @brief Switches nb_hosts free hosts to the sleep pstate of ResourceIndex::sleep(), or as many
+   *        asleep hosts back to its awake pstate.
+   * @details The hosts are asleep (free) once the transition time elapsed: Batsim is asked to call
+   *          back then, and the next pass sees the HOSTS_SWITCHED change.
+   * @return The number of hosts switched, fewer if fewer hosts are free (asleep).
+   */
+  uint32_t switch_off(uint32_t nb_hosts, double now);
+  uint32_t switch_on(uint32_t nb_hosts, double now);
+  // Hosts switching off or on
+  size_t nb_transitions() const { return _part->transitions.size(); }
+
+  /**
+   * @brief Asks Batsim to call the decision component back at time (rounded up to the second),
+   *        e.g. when a blocked job is predicted to have enough energy.
+   * @details Requests are coalesced: nothing is sent if a wakeup is already pending at or before
+   *          this instant, the policy being expected to request again when woken up.
+   */
+  void request_wakeup(double time, double now);
+  // Number of wakeups requested and not received yet
+  size_t nb_pending_wakeups() const { return _part->wakeups.size(); }
+
+  // Pending jobs as arrays, in FCFS order, for the parallel filters
+  QueueArrays & queue_arrays() { return _part->queue_arrays; }
+  // Whether scans over size pending jobs are worth filtering in parallel, see QueueArrays
+  bool parallel(size_t size) const { return size >= _parallel_threshold && _nb_workers > 0; }
+  // Pool of the parallel filters, started on first use
+  WorkerPool & workers() {
+    if (!_workers.started()) {
+      _workers.start(_nb_workers);
+    }
+    return _workers;
+  }
+
+  /**
+   * @brief Writes the state of the engine and of its policy at now to path, as JSON: platform,
+   *        pending and running jobs with their hosts, energy account and reservations, sleeping
+   *        hosts, pending wakeups and metrics. See edc_snapshot.hpp.
+   * @details Done at the end of the first call at or after the snapshot_time key, to the
+   *          snapshot_file one. A component initialized with the restore_file key resumes from it.
+   *          Only supported on unpartitioned platforms.
+   * @return False if the file cannot be written.
+   */
+  bool save_snapshot(const std::string & path, double now) const;
+
+  // Changes since the previous pass that triggered the current one, see Change
+  uint32_t changes() const { return _part->changes; }
+  // First job queued since the previous pass, nullptr if none. Jobs are queued in FCFS order,
+  // so the following ones are the other new jobs. A pass whose only change is JOBS_SUBMITTED
+  // may resume its scan from there, the jobs before it being as blocked as in the previous pass.
+  SchedJob * first_submitted() const { return _part->jobs.get(_part->first_submitted); }
+  /**
+   * @brief Runs a new pass once energy can be taken now without delaying the reservations
+   *        (see EnergyLedger::earliest_start), e.g. the energy of the cheapest blocked job.
+   * @details NEVER if no pending job waits for energy. The threshold holds until it is set again.
+   *          A negative threshold, the default, runs a pass on every call.
+   */
+  void set_energy_threshold(double energy) { _part->energy_threshold = energy; }
+  double energy_threshold() const { return _part->energy_threshold; }
+
+private:
+  // Hosts switching pstate, by the end of their transition
+  struct Transition {
+    HostAllocation hosts;
+    bool on;
+  };
+
+  // A partition: its hosts, its policy and what the policy works on
+  struct Partition {
+    std::string name;
+    std::unique_ptr<Policy> policy;
+    HostAllocation hosts;           // Hosts of the platform, host i of the partition is the i-th
+    bool all_hosts = true;          // The partition is the whole platform: hosts are not renumbered
+    JobStore jobs;
+    ResourceIndex resources;
+    EnergyLedger energy;
+    QueueArrays queue_arrays;
+    std::multimap<double, Transition> transitions;
+    // Running jobs launched with a corrected walltime, by expected end time
+    std::set<std::pair<double, JobHandle>> estimated_ends;
+    std::set<uint64_t> wakeups;     // Instants of the pending wakeups
+    double pending_work = 0;        // Walltime of the pending jobs per host, to route jobs (s)
+
+    // State of the previous pass, to detect the changes since then
+    uint32_t changes = NO_CHANGE;
+    JobHandle first_submitted = NO_JOB;
+    double due_time = EnergyLedger::NEVER; // Earliest wakeup requested by the previous pass
+    double energy_threshold = -1;
+    double pass_rate = 0;
+    bool pass_in_window = false;
+  };
+
+  void handle_job_submitted(const batprotocol::fb::JobSubmittedEvent * event, double now);
+  void handle_job_completed(const batprotocol::fb::JobCompletedEvent * event, double now);
+  void handle_requested_call(const batprotocol::fb::RequestedCallEvent * event, double now);
+  // Sets the hosts of the partitions and resets their resources, with the powers of the hosts if
+  // platform_power is set. The hosts of a partition not in the platform are left out.
+  void reset_hosts(const batprotocol::fb::SimulationBeginsEvent * event);
+  // Partition of a submitted job: the one named as its workload, or else the least loaded one
+  // it fits in. nullptr if it fits in none.
+  Partition * route(std::string_view job_id, uint32_t nb_hosts);
+  // The events and pass handled next are the ones of partition
+  void select(Partition & partition) { _part = &partition; }
+  // Writes hosts of the current partition with the ids of the platform
+  void write_platform_hosts(const HostAllocation & hosts, std::string & buffer);
+  // Power the sleeping hosts of all the partitions save, see ResourceIndex::sleep_power_saving()
+  double sleep_power_saving() const;
+  const char * policy_name() const { return _partitions.front()->policy->name(); }
+  // Adds the energy changes of the current partition since its previous pass to its changes
+  void check_energy(double now);
+  // Ends the pstate transitions of the current partition due by now, accounting the energy at their end
+  void finish_transitions(double now);
+  // Running jobs that outlived their corrected walltime are expected until their requested one
+  void extend_estimates(double now);
+  // Resumes from a snapshot of save_snapshot(), once the policy is configured. The simulator
+  // resumes from the snapshot time too. Returns false if the snapshot is invalid.
+  bool restore_snapshot(const std::string & path);
+
+private:
+  PolicyFactory _make_policy = nullptr;
+  std::vector<std::unique_ptr<Partition>> _partitions;
+  bool _partitioned = false;   // Partitions configured, else a single one with all the hosts
+  Partition * _part = nullptr; // Partition whose event or pass is handled
+  std::string _partition_property; // Host property naming the partition of each host, if any
+  batprotocol::MessageBuilder * _mb = nullptr;
+  bool _format_binary = true;
+
+  std::string _hosts_buffer; // Hosts of the launched job, reused between launches
+  HostAllocation _platform_hosts; // Same, renumbered for the platform
+  uint32_t _nb_launched = 0;   // Jobs launched by the current call
+  DecisionStats _stats;
+  OnlineMetrics _metrics;
+  bool _platform_power = false; // Powers of the hosts read from the platform, see reset_hosts()
+  size_t _parallel_threshold = 16384; // Queue length from which scans are filtered in parallel
+  unsigned _nb_workers = 3;
+  WorkerPool _workers;
+  bool _walltime_correction = false;
+  WalltimePredictor _predictor;
+  uint64_t _nb_wakeups = 0;    // Wakeups requested so far, numbers their call_me_later ids
+  std::string _snapshot_path;
+  double _snapshot_time = EnergyLedger::NEVER; // Of the snapshot still to write
+  bool _restored = false; // Resumed from a restore_file, the platform is the one of the snapshot
+};
+
+// Implementation of the EDC C API by a single engine, running the policies of make_policy
+uint8_t edc_init(PolicyFactory make_policy, const uint8_t * data, uint32_t size, uint32_t flags);
+uint8_t edc_deinit();
+uint8_t edc_take_decisions(const uint8_t * what_happened, uint32_t what_happened_size,
+                           uint8_t ** decisions, uint32_t * decisions_size);
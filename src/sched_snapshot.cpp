@@ -0,0 +1,281 @@
+// Snapshots of the engine state, see SchedEngine::save_snapshot() and edc_snapshot.hpp
+
+#include "sched_engine.hpp"
+
+#include <fstream>
+
+#include "edc_log.hpp"
+#include "edc_snapshot.hpp"
+
+// Job of a snapshot entry, created with its request but neither pending nor running.
+// nullptr if a job of this id is already known.
+static SchedJob * create_job(JobStore & jobs, const nlohmann::json & entry) {
+  SchedJob * job = jobs.create(entry.at("id").get<std::string>());
+  if (job == nullptr) {
+    return nullptr;
+  }
+  entry.at("nb_hosts").get_to(job->nb_hosts);
+  entry.at("walltime").get_to(job->requested_walltime);
+  job->walltime = entry.value("estimated_walltime", job->requested_walltime);
+  entry.at("submission_time").get_to(job->submission_time);
+  return job;
+}
+
+static nlohmann::json job_to_json(const SchedJob * job) {
+  nlohmann::json entry = {{"id", job->id}, {"nb_hosts", job->nb_hosts}, {"walltime", job->requested_walltime},
+                          {"submission_time", job->submission_time}};
+  if (job->walltime != job->requested_walltime) {
+    entry["estimated_walltime"] = job->walltime;
+  }
+  return entry;
+}
+
+bool SchedEngine::save_snapshot(const std::string & path, double now) const {
+  // snapshots are only taken without partitions, see init()
+  const Partition & partition = *_partitions.front();
+  nlohmann::json snapshot = {{"format", SNAPSHOT_FORMAT}, {"time", now}};
+
+  const HostPowerTable & powers = partition.resources.host_powers();
+  nlohmann::json & platform = snapshot["platform"];
+  platform["nb_hosts"] = partition.resources.nb_hosts();
+  ResourceIndex::PowerSums sums = partition.resources.power_sums();
+  platform["power_sums"] = {sums.computing, sums.idle, sums.sleep, sums.sleep_idle};
+  if (_platform_power) {
+    nlohmann::json & host_powers = platform["host_powers"] = nlohmann::json::array();
+    for (uint32_t host = 0; host < powers.nb_hosts(); ++host) {
+      host_powers.push_back({powers.computing_power(host), powers.idle_power(host)});
+    }
+  }
+
+  // the reservations of the policies are keyed by job handle
+  nlohmann::json & energy = snapshot["energy"];
+  energy["available"] = partition.energy.available();
+  energy["consumed"] = partition.energy.consumed();
+  energy["reservations"] = nlohmann::json::array();
+  for (const EnergyLedger::Reservation & reservation : partition.energy.reservations()) {
+    const SchedJob * job = partition.jobs.get(reservation.key);
+    if (job == nullptr) {
+      LOG_WARNING("Reservation %u of no job left out of the snapshot\n", reservation.key);
+      continue;
+    }
+    energy["reservations"].push_back({{"job", job->id}, {"start", reservation.start}, {"energy", reservation.energy}});
+  }
+
+  nlohmann::json & pending = snapshot["pending"] = nlohmann::json::array();
+  for (const SchedJob * job : partition.jobs.pending()) {
+    pending.push_back(job_to_json(job));
+  }
+  nlohmann::json & running = snapshot["running"] = nlohmann::json::array();
+  for (JobHandle handle = 0; handle < partition.jobs.handle_capacity(); ++handle) {
+    const SchedJob * job = partition.jobs.get(handle);
+    if (job == nullptr || !partition.jobs.is_running(handle)) {
+      continue;
+    }
+    nlohmann::json entry = job_to_json(job);
+    entry["start_time"] = job->start_time;
+    entry["expected_end_time"] = job->expected_end_time;
+    entry["estimated_energy"] = job->estimated_energy;
+    entry["hosts"] = hosts_to_json(job->allocation);
+    running.push_back(std::move(entry));
+  }
+
+  HostAllocation asleep;
+  partition.resources.asleep().find(partition.resources.nb_asleep(), asleep);
+  snapshot["asleep"] = hosts_to_json(asleep);
+  nlohmann::json & transitions = snapshot["transitions"] = nlohmann::json::array();
+  for (const auto & transition : partition.transitions) {
+    transitions.push_back({{"end", transition.first}, {"on", transition.second.on},
+                           {"hosts", hosts_to_json(transition.second.hosts)}});
+  }
+  snapshot["wakeups"] = partition.wakeups;
+  snapshot["nb_wakeups"] = _nb_wakeups;
+  // what the next pass depends on, so that it runs as it would have
+  snapshot["pass"] = {{"due_time", double_to_json(partition.due_time)}, {"energy_threshold", double_to_json(partition.energy_threshold)},
+                      {"rate", partition.pass_rate}, {"in_window", partition.pass_in_window}};
+
+  _metrics.save(snapshot["metrics"]);
+  if (_walltime_correction) {
+    _predictor.save(snapshot["walltime_predictor"]);
+  }
+  nlohmann::json & policy = snapshot["policy"];
+  policy["name"] = partition.policy->name();
+  policy["state"] = nlohmann::json::object();
+  partition.policy->save_state(*this, policy["state"]);
+
+  std::ofstream file(path);
+  file << snapshot.dump() << '\n';
+  file.close();
+  if (!file) {
+    LOG_ERROR("Cannot write snapshot to '%s'\n", path.c_str());
+    return false;
+  }
+  LOG_INFO("[%.1f] Snapshot of %zu pending and %zu running jobs written to '%s'\n",
+           now, pending.size(), running.size(), path.c_str());
+  return true;
+}
+
+bool SchedEngine::restore_snapshot(const std::string & path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG_ERROR("Cannot read snapshot '%s'\n", path.c_str());
+    return false;
+  }
+
+  Partition & partition = *_partitions.front();
+  select(partition);
+  double now = 0;
+  bool restored_policy = false;
+  try {
+    nlohmann::json snapshot = nlohmann::json::parse(file);
+    if (snapshot.at("format").get<int>() != SNAPSHOT_FORMAT) {
+      LOG_ERROR("Snapshot '%s' is of format %d, only %d is supported\n", path.c_str(),
+                snapshot.at("format").get<int>(), SNAPSHOT_FORMAT);
+      return false;
+    }
+    snapshot.at("time").get_to(now);
+
+    // the platform as at simulation start, with the powers of the snapshot if read from the platform
+    const nlohmann::json & platform = snapshot.at("platform");
+    uint32_t nb_hosts = platform.at("nb_hosts").get<uint32_t>();
+    partition.hosts.clear();
+    if (nb_hosts > 0) {
+      partition.hosts.append(0, nb_hosts - 1);
+    }
+    auto host_powers = platform.find("host_powers");
+    if (host_powers == platform.end()) {
+      partition.resources.reset(nb_hosts);
+    } else {
+      if (host_powers->size() != nb_hosts) {
+        LOG_ERROR("Snapshot '%s' has powers for %zu hosts out of %u\n", path.c_str(), host_powers->size(), nb_hosts);
+        return false;
+      }
+      HostPowerTable powers;
+      powers.reset(nb_hosts, partition.resources.host_computing_power(), partition.resources.host_idle_power());
+      for (uint32_t host = 0; host < nb_hosts; ++host) {
+        powers.set(host, (*host_powers)[host].at(0).get<double>(), (*host_powers)[host].at(1).get<double>());
+      }
+      powers.build();
+      partition.resources.reset(powers);
+    }
+    partition.energy.reset(now);
+    _metrics.reset(nb_hosts, partition.resources.host_powers().total_idle_power());
+    partition.policy->on_simulation_begins(*this, now);
+
+    // the account once the policy set the budget periods
+    const nlohmann::json & energy = snapshot.at("energy");
+    partition.energy.restore(now, energy.at("available").get<double>(), energy.at("consumed").get<double>());
+    _metrics.restore(snapshot.at("metrics"));
+    // the walltimes of the jobs pending or running are the ones of the snapshot run, the next
+    // ones are corrected from its samples
+    auto predictor = snapshot.find("walltime_predictor");
+    if (_walltime_correction && predictor != snapshot.end() && !_predictor.restore(*predictor)) {
+      LOG_ERROR("Invalid walltime predictor in snapshot '%s'\n", path.c_str());
+      return false;
+    }
+
+    for (const nlohmann::json & entry : snapshot.at("running")) {
+      SchedJob * job = create_job(partition.jobs, entry);
+      if (job == nullptr) {
+        LOG_ERROR("Job %s twice in snapshot '%s'\n", entry.at("id").get<std::string>().c_str(), path.c_str());
+        return false;
+      }
+      entry.at("start_time").get_to(job->start_time);
+      entry.at("estimated_energy").get_to(job->estimated_energy);
+      job->expected_end_time = entry.value("expected_end_time", job->start_time + job->walltime);
+      if (!hosts_from_json(entry.at("hosts"), job->allocation) || job->allocation.nb_hosts != job->nb_hosts ||
+          !partition.resources.allocate(job->allocation, job->expected_end_time)) {
+        LOG_ERROR("Invalid hosts of job %s in snapshot '%s'\n", job->id.c_str(), path.c_str());
+        return false;
+      }
+      partition.jobs.queue(job);
+      partition.jobs.start(job);
+      if (job->expected_end_time < job->start_time + job->requested_walltime) {
+        partition.estimated_ends.emplace(job->expected_end_time, job->handle);
+      }
+    }
+
+    // the sleeping hosts, asleep or still switching
+    HostAllocation asleep;
+    if (!hosts_from_json(snapshot.at("asleep"), asleep) || !partition.resources.switch_off(asleep)) {
+      LOG_ERROR("Invalid asleep hosts in snapshot '%s'\n", path.c_str());
+      return false;
+    }
+    partition.resources.switched_off(asleep);
+    for (const nlohmann::json & entry : snapshot.at("transitions")) {
+      Transition transition{HostAllocation(), entry.at("on").get<bool>()};
+      double end = entry.at("end").get<double>();
+      bool valid = hosts_from_json(entry.at("hosts"), transition.hosts) && partition.resources.switch_off(transition.hosts);
+      if (valid && transition.on) {
+        partition.resources.switched_off(transition.hosts);
+        valid = partition.resources.switch_on(transition.hosts, end);
+      }
+      if (!valid) {
+        LOG_ERROR("Invalid hosts switching pstate in snapshot '%s'\n", path.c_str());
+        return false;
+      }
+      partition.transitions.emplace(end, std::move(transition));
+    }
+
+    // the pending jobs are estimated by the policy of this run, as if submitted now
+    for (const nlohmann::json & entry : snapshot.at("pending")) {
+      SchedJob * job = create_job(partition.jobs, entry);
+      if (job == nullptr || job->nb_hosts > nb_hosts) {
+        LOG_ERROR("Invalid pending job %s in snapshot '%s'\n", entry.at("id").get<std::string>().c_str(), path.c_str());
+        return false;
+      }
+      if (!_walltime_correction) {
+        job->walltime = job->requested_walltime;
+      }
+      partition.jobs.queue(job);
+      partition.policy->on_job_submitted(*this, job, now);
+      partition.queue_arrays.push_back(job);
+    }
+    const nlohmann::json & sums = platform.at("power_sums");
+    partition.resources.restore_power_sums({sums.at(0).get<double>(), sums.at(1).get<double>(),
+                                   sums.at(2).get<double>(), sums.at(3).get<double>()});
+    partition.energy.set_power(partition.resources.power());
+
+    // the reservations belong to the policy that made them, another one starts without
+    const nlohmann::json & policy = snapshot.at("policy");
+    restored_policy = (policy.at("name").get<std::string>() == partition.policy->name());
+    if (restored_policy) {
+      for (const nlohmann::json & entry : energy.at("reservations")) {
+        JobHandle handle = partition.jobs.handle_of(entry.at("job").get<std::string>());
+        if (handle == NO_JOB) {
+          LOG_ERROR("Reservation of unknown job %s in snapshot '%s'\n",
+                    entry.at("job").get<std::string>().c_str(), path.c_str());
+          return false;
+        }
+        partition.energy.reserve(handle, entry.at("start").get<double>(), entry.at("energy").get<double>());
+      }
+      if (!partition.policy->restore_state(*this, policy.at("state"))) {
+        LOG_ERROR("Invalid state of %s in snapshot '%s'\n", partition.policy->name(), path.c_str());
+        return false;
+      }
+    } else {
+      LOG_WARNING("Snapshot '%s' of %s: reservations and policy state are not restored\n",
+                  path.c_str(), policy.at("name").get<std::string>().c_str());
+    }
+
+    for (const nlohmann::json & wakeup : snapshot.at("wakeups")) {
+      partition.wakeups.insert(wakeup.get<uint64_t>());
+    }
+    snapshot.at("nb_wakeups").get_to(_nb_wakeups);
+    const nlohmann::json & pass = snapshot.at("pass");
+    partition.due_time = double_from_json(pass.at("due_time"));
+    partition.energy_threshold = double_from_json(pass.at("energy_threshold"));
+    pass.at("rate").get_to(partition.pass_rate);
+    pass.at("in_window").get_to(partition.pass_in_window);
+  } catch (const nlohmann::json::exception & e) {
+    LOG_ERROR("Invalid snapshot '%s': %s\n", path.c_str(), e.what());
+    return false;
+  }
+
+  // the next pass runs as it would have in the snapshot run, unless its policy was another one
+  if (!restored_policy) {
+    partition.changes |= RESTORED;
+  }
+  LOG_INFO("[%.1f] Restored %zu pending and %zu running jobs from '%s'\n",
+           now, partition.jobs.pending().size(), partition.jobs.nb_running(), path.c_str());
+  return true;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <set>
+#include <vector>
+
+/**
+ * @brief Queue of the pending jobs, indexed for backfilling.
+ * @details Jobs are kept in FCFS order and indexed by job handle, so any job is erased in O(1).
+ *          They are also kept sorted by walltime in buckets of similar sizes (one bucket per
+ *          power of two of nb_hosts), so the walltime-ordered iteration over the jobs that fit
+ *          in k hosts never looks at the buckets of larger jobs.
+ *
+ *          Job must provide handle (a dense integer), nb_hosts and walltime members.
+ *          The queue does not own the jobs.
+ */
+template <typename Job>
+class WaitQueue {
+  struct WalltimeKey {
+    double walltime;
+    uint64_t seq; // submission order, breaks walltime ties as FCFS
+    Job * job;
+
+    bool operator<(const WalltimeKey & other) const {
+      return walltime < other.walltime || (walltime == other.walltime && seq < other.seq);
+    }
+  };
+  typedef std::set<WalltimeKey> Bucket;
+  static const uint32_t NB_BUCKETS = 33;
+
+  static const uint32_t NOT_QUEUED = UINT32_MAX;
+
+  struct Position {
+    typename std::list<Job *>::iterator fcfs;
+    typename Bucket::iterator by_walltime;
+    uint32_t bucket = NOT_QUEUED;
+  };
+
+public:
+  typedef typename std::list<Job *>::iterator iterator;
+  typedef typename std::list<Job *>::const_iterator const_iterator;
+
+  /**
+   * @brief Iterates over the jobs by increasing walltime, merging the eligible buckets.
+   * @details The job returned by next() may be erased from the queue before next() is called again.
+   *          No other job may be erased while the cursor is in use.
+   */
+  class WalltimeCursor {
+  public:
+    // Returns the next job with nb_hosts <= max_hosts, or nullptr if there is none.
+    // max_hosts may decrease between calls, e.g. as hosts get allocated.
+    Job * next(uint32_t max_hosts) {
+      while (!_heads.empty()) {
+        std::pop_heap(_heads.begin(), _heads.end(), HeadGreater());
+        Head head = _heads.back();
+        _heads.pop_back();
+
+        // the smallest job of the bucket is too large: so is the whole bucket
+        if (bucket_min_hosts(head.bucket) > max_hosts) {
+          continue;
+        }
+
+        Job * job = head.it->job;
+        if (++head.it != head.end) {
+          _heads.push_back(head);
+          std::push_heap(_heads.begin(), _heads.end(), HeadGreater());
+        }
+
+        if (job->nb_hosts <= max_hosts) {
+          return job;
+        }
+      }
+      return nullptr;
+    }
+
+  private:
+    friend class WaitQueue;
+
+    struct Head {
+      typename Bucket::const_iterator it;
+      typename Bucket::const_iterator end;
+      uint32_t bucket;
+    };
+    struct HeadGreater {
+      bool operator()(const Head & a, const Head & b) const { return *b.it < *a.it; }
+    };
+
+    std::vector<Head> _heads; // min-heap of the current element of each bucket
+  };
+
+  WaitQueue() : _buckets(NB_BUCKETS) {}
+
+  bool empty() const { return _fcfs.empty(); }
+  size_t size() const { return _fcfs.size(); }
+  Job * front() const { return _fcfs.front(); }
+
+  iterator begin() { return _fcfs.begin(); }
+  iterator end() { return _fcfs.end(); }
+  const_iterator begin() const { return _fcfs.begin(); }
+  const_iterator end() const { return _fcfs.end(); }
+
+  // Returns the queued job of handle, or nullptr
+  template <typename Handle>
+  Job * find(Handle handle) const {
+    const Position * position = position_of(handle);
+    return (position == nullptr) ? nullptr : *(position->fcfs);
+  }
+  // Returns the FCFS iterator of the queued job of handle, or end()
+  template <typename Handle>
+  iterator iterator_to(Handle handle) {
+    const Position * position = position_of(handle);
+    return (position == nullptr) ? end() : position->fcfs;
+  }
+
+  void push_back(Job * job) {
+    if (job->handle >= _positions.size()) {
+      _positions.resize(std::max<size_t>(job->handle + 1, 2 * _positions.size()));
+    }
+
+    uint32_t bucket = bucket_of(job->nb_hosts);
+    Position & position = _positions[job->handle];
+    position.fcfs = _fcfs.insert(_fcfs.end(), job);
+    position.by_walltime = _buckets[bucket].insert({job->walltime, _next_seq++, job}).first;
+    position.bucket = bucket;
+  }
+
+  void pop_front() {
+    erase(_fcfs.front());
+  }
+
+  // Removes job from the queue. Returns false if it was not queued.
+  bool erase(Job * job) {
+    if (position_of(job->handle) == nullptr) {
+      return false;
+    }
+    remove(_positions[job->handle]);
+    return true;
+  }
+
+  // Removes the job at it, returns the iterator to the following job in FCFS order
+  iterator erase(iterator it) {
+    iterator next = std::next(it);
+    remove(_positions[(*it)->handle]);
+    return next;
+  }
+
+  // Removes all jobs
+  void clear() {
+    _fcfs.clear();
+    for (Bucket & bucket : _buckets) {
+      bucket.clear();
+    }
+    _positions.clear();
+  }
+
+  // Iterates over the queued jobs by increasing walltime, see WalltimeCursor
+  WalltimeCursor by_walltime() const {
+    WalltimeCursor cursor;
+    for (uint32_t b = 0; b < NB_BUCKETS; ++b) {
+      if (!_buckets[b].empty()) {
+        cursor._heads.push_back({_buckets[b].begin(), _buckets[b].end(), b});
+      }
+    }
+    std::make_heap(cursor._heads.begin(), cursor._heads.end(), typename WalltimeCursor::HeadGreater());
+    return cursor;
+  }
+
+private:
+  // Bucket b holds the jobs with nb_hosts in [2^(b-1), 2^b), bucket 0 the jobs without hosts
+  static uint32_t bucket_of(uint32_t nb_hosts) {
+    return (nb_hosts == 0) ? 0 : 32 - __builtin_clz(nb_hosts);
+  }
+  static uint32_t bucket_min_hosts(uint32_t bucket) {
+    return (bucket == 0) ? 0 : (uint32_t(1) << (bucket - 1));
+  }
+
+  template <typename Handle>
+  const Position * position_of(Handle handle) const {
+    if (handle >= _positions.size() || _positions[handle].bucket == NOT_QUEUED) {
+      return nullptr;
+    }
+    return &_positions[handle];
+  }
+
+  void remove(Position & position) {
+    _buckets[position.bucket].erase(position.by_walltime);
+    _fcfs.erase(position.fcfs);
+    position.bucket = NOT_QUEUED;
+  }
+
+private:
+  std::list<Job *> _fcfs;
+  std::vector<Bucket> _buckets;
+  std::vector<Position> _positions; // by job handle
+  uint64_t _next_seq = 0;
+};
@@ -0,0 +1,96 @@
+#include "walltime_predictor.hpp"
+
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+// Scale of the sample weights from which they are renormalized, far from overflowing
+static const double MAX_SCALE = 1e100;
+
+void WalltimePredictor::configure(double quantile, uint32_t min_samples, double decay) {
+  _quantile = quantile;
+  _min_samples = min_samples;
+  _decay = decay;
+  reset();
+}
+
+void WalltimePredictor::reset() {
+  _classes.fill(SizeClass());
+}
+
+double WalltimePredictor::estimate(uint32_t nb_hosts, double walltime) const {
+  const SizeClass & size_class = _classes[class_of(nb_hosts)];
+  if (walltime <= 0 || size_class.nb_samples < _min_samples) {
+    return walltime;
+  }
+  return walltime * size_class.ratio;
+}
+
+void WalltimePredictor::on_job_completed(uint32_t nb_hosts, double walltime, double runtime) {
+  if (walltime <= 0) {
+    return; // no walltime to correct
+  }
+
+  double ratio = std::min(std::max(runtime / walltime, 0.0), 1.0);
+  uint32_t bin = std::min(NB_BINS - 1, static_cast<uint32_t>(ratio * NB_BINS));
+  SizeClass & size_class = _classes[class_of(nb_hosts)];
+  size_class.weights[bin] += size_class.scale;
+  size_class.total += size_class.scale;
+  ++size_class.nb_samples;
+
+  // the older samples decay relatively to the newer ones
+  size_class.scale /= _decay;
+  if (size_class.scale > MAX_SCALE) {
+    for (double & weight : size_class.weights) {
+      weight /= size_class.scale;
+    }
+    size_class.total /= size_class.scale;
+    size_class.scale = 1;
+  }
+  update_ratio(size_class);
+}
+
+void WalltimePredictor::update_ratio(SizeClass & size_class) const {
+  // the upper bound of the bin of the quantile, so that the corrected walltime covers it
+  double target = _quantile * size_class.total;
+  double cumulated = 0;
+  uint32_t bin = 0;
+  for (; bin + 1 < NB_BINS; ++bin) {
+    cumulated += size_class.weights[bin];
+    if (cumulated >= target) {
+      break;
+    }
+  }
+  size_class.ratio = static_cast<double>(bin + 1) / NB_BINS;
+}
+
+void WalltimePredictor::save(nlohmann::json & state) const {
+  state = nlohmann::json::array();
+  for (uint32_t c = 0; c < NB_CLASSES; ++c) {
+    const SizeClass & size_class = _classes[c];
+    if (size_class.nb_samples > 0) {
+      state.push_back({{"class", c}, {"weights", size_class.weights}, {"scale", size_class.scale},
+                       {"nb_samples", size_class.nb_samples}});
+    }
+  }
+}
+
+bool WalltimePredictor::restore(const nlohmann::json & state) {
+  reset();
+  for (const nlohmann::json & entry : state) {
+    uint32_t c = entry.at("class").get<uint32_t>();
+    const nlohmann::json & weights = entry.at("weights");
+    if (c >= NB_CLASSES || weights.size() != NB_BINS) {
+      return false;
+    }
+    SizeClass & size_class = _classes[c];
+    for (uint32_t bin = 0; bin < NB_BINS; ++bin) {
+      weights[bin].get_to(size_class.weights[bin]);
+      size_class.total += size_class.weights[bin];
+    }
+    entry.at("scale").get_to(size_class.scale);
+    entry.at("nb_samples").get_to(size_class.nb_samples);
+    update_ratio(size_class);
+  }
+  return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <nlohmann/json_fwd.hpp>
+
+/**
+ * @brief Online correction of the requested walltimes, learnt from the runtimes of the completed jobs.
+ * @details The ratios of the runtime to the requested walltime are kept per size class (one per
+ *          power of two of nb_hosts, as the buckets of WaitQueue) in a histogram of NB_BINS ratios
+ *          whose weights decay exponentially with each sample: constant memory per class, which
+ *          follows the changes of the workload. The walltime of a job is corrected to the quantile
+ *          of the ratios of its class, once the class has enough samples.
+ *
+ *          The corrected walltime only tightens the backfilling windows and energy estimates, the
+ *          requested one is still the one after which the job is killed.
+ */
+class WalltimePredictor {
+public:
+  static const uint32_t NB_BINS = 32;
+  static const uint32_t NB_CLASSES = 33;
+
+  // Corrects to the quantile (in (0, 1]) of the ratios of a class once it has min_samples samples,
+  // the weight of a sample being multiplied by decay (in (0, 1]) with each later one of its class
+  void configure(double quantile, uint32_t min_samples, double decay);
+  // Forgets all the samples
+  void reset();
+
+  // Walltime to schedule a job of nb_hosts hosts requesting walltime with (s): within (0, walltime],
+  // walltime itself while its class has fewer than min_samples samples
+  double estimate(uint32_t nb_hosts, double walltime) const;
+  // A job of nb_hosts hosts requesting walltime ran for runtime (s), killed or not
+  void on_job_completed(uint32_t nb_hosts, double walltime, double runtime);
+
+  // Samples learnt so far, for snapshots (see SchedEngine::save_snapshot()), and back. restore()
+  // returns false if the classes of state are invalid, and throws nlohmann::json::exception if
+  // they are not classes.
+  void save(nlohmann::json & state) const;
+  bool restore(const nlohmann::json & state);
+
+private:
+  struct SizeClass {
+    std::array<double, NB_BINS> weights{}; // Decayed weight of the ratios of each bin, times scale
+    double total = 0;                      // Sum of the weights
+    double scale = 1;                      // Weight of the next sample, grows instead of decaying the others
+    uint32_t nb_samples = 0;
+    double ratio = 1;                      // Quantile of the ratios, upper bound of its bin
+  };
+
+  static uint32_t class_of(uint32_t nb_hosts) {
+    return (nb_hosts == 0) ? 0 : 32 - __builtin_clz(nb_hosts);
+  }
+  void update_ratio(SizeClass & size_class) const;
+
+  std::array<SizeClass, NB_CLASSES> _classes;
+  double _quantile = 0.9;
+  uint32_t _min_samples = 20;
+  double _decay = 0.99;
+};
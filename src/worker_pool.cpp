@@ -0,0 +1,78 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (std::thread & thread : _threads) {
+    thread.join();
+  }
+}
+
+void WorkerPool::start(unsigned nb_workers) {
+  _started = true;
+  _threads.reserve(nb_workers);
+  for (unsigned i = 0; i < nb_workers; ++i) {
+    _threads.emplace_back(&WorkerPool::work, this);
+  }
+}
+
+void WorkerPool::run(size_t size, const std::function<void(size_t, size_t)> & task) {
+  if (size == 0) {
+    return;
+  }
+  if (_threads.empty()) {
+    task(0, size);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _task = &task;
+    _size = size;
+    // a few chunks per thread balance the load without contending on the counter
+    _chunk = std::max<size_t>(1, size / (4 * nb_threads()));
+    _next.store(0);
+    _nb_running = static_cast<unsigned>(_threads.size());
+    ++_generation;
+  }
+  _wake.notify_all();
+
+  run_chunks();
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _nb_running == 0; });
+  _task = nullptr;
+}
+
+void WorkerPool::run_chunks() {
+  for (size_t begin = _next.fetch_add(_chunk); begin < _size; begin = _next.fetch_add(_chunk)) {
+    (*_task)(begin, std::min(begin + _chunk, _size));
+  }
+}
+
+void WorkerPool::work() {
+  uint64_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [&] { return _stop || _generation != generation; });
+      if (_stop) {
+        return;
+      }
+      generation = _generation;
+    }
+
+    run_chunks();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      --_nb_running;
+    }
+    _done.notify_one();
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Small pool of threads running data-parallel loops, e.g. over the pending jobs.
+ * @details The threads are started once and sleep between loops. A loop is split into contiguous
+ *          chunks taken by the threads of the pool and by the calling thread, which returns once
+ *          all chunks are done. Tasks must not throw, nor start loops themselves.
+ */
+class WorkerPool {
+public:
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool & operator=(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  // Starts nb_workers threads besides the calling one. With none, loops run on the calling thread.
+  void start(unsigned nb_workers);
+  bool started() const { return _started; }
+  // Threads taking part in a loop, the calling one included
+  unsigned nb_threads() const { return static_cast<unsigned>(_threads.size()) + 1; }
+
+  // Calls task(begin, end) on a partition of [0, size) into contiguous ranges
+  void run(size_t size, const std::function<void(size_t, size_t)> & task);
+
+private:
+  void work();
+  // Runs the chunks of the current loop until none is left
+  void run_chunks();
+
+private:
+  std::vector<std::thread> _threads;
+  bool _started = false;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;  // A loop starts, or the pool stops
+  std::condition_variable _done;  // A thread finished its chunks
+  uint64_t _generation = 0;       // Loops started so far
+  unsigned _nb_running = 0;       // Threads of the pool still in the current loop
+  bool _stop = false;
+
+  // Current loop
+  const std::function<void(size_t, size_t)> * _task = nullptr;
+  size_t _size = 0;
+  size_t _chunk = 1;
+  std::atomic<size_t> _next{0};
+};